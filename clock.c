@@ -16,14 +16,15 @@
 /******************************************************* 
  * Machine dependent functions 
  *
- * Note: the constants __i386__ and  __alpha
+ * Note: the constants __i386__, __x86_64__ and  __alpha
  * are set by GCC when it calls the C preprocessor
  * You can verify this for yourself using gcc -v.
  *******************************************************/
 
-#if defined(__i386__)
+#if defined(__i386__) || defined(__x86_64__)
 /*******************************************************
  * Pentium versions of start_counter() and get_counter()
+ * (rdtsc works the same way on x86-64)
  *******************************************************/
 
 
@@ -68,6 +69,14 @@ double get_counter() {
 }
 /* $end x86cyclecounter */
 
+/* Return the raw value of the cycle counter. */
+unsigned long long read_counter() {
+    unsigned hi, lo;
+
+    access_counter(&hi, &lo);
+    return ((unsigned long long)hi << 32) | lo;
+}
+
 #elif defined(__alpha)
 
 /****************************************************
@@ -128,6 +137,10 @@ double get_counter() {
     return result;
 }
 
+unsigned long long read_counter() {
+    return counter();
+}
+
 #else
 
 /****************************************************************
@@ -151,6 +164,13 @@ double get_counter() {
     printf("Please choose another timing package in config.h.\n");
     exit(1);
 }
+
+unsigned long long read_counter() {
+    printf("ERROR: You are trying to use a read_counter routine in clock.c\n");
+    printf("that has not been implemented yet on this platform.\n");
+    printf("Please choose another timing package in config.h.\n");
+    exit(1);
+}
 #endif
 
 
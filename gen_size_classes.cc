@@ -0,0 +1,275 @@
+/*
+ * gen_size_classes.cc - size-class table generator and trace profiler
+ *
+ *   gen_size_classes              print size_classes.h, the C rendering of
+ *                                 the constexpr tables in size_classes.hpp
+ *   gen_size_classes -p <traces>  print a size_class_spec.hpp whose class
+ *                                 bounds group the requests in the given
+ *                                 traces (text, binary or compressed)
+ *                                 into classes of similar size
+ *
+ * mm never rounds a request up to its class bound, so the bounds do not
+ * change how much memory a request takes. They decide which free blocks
+ * mm_get_stats counts together, how precise the may_fit mask is, and how
+ * large a slab an arena takes for each size.
+ */
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <vector>
+
+#include "size_classes.hpp"
+
+extern "C" {
+#include "trace.h"
+}
+
+using mm::size_classes::kLookup;
+using mm::size_classes::kLookupEntries;
+using mm::size_classes::kLookupLimit;
+using mm::size_classes::kNumClasses;
+using mm::size_classes::kSlabSize;
+
+/* Objects per slab written into generated specs */
+#define SLAB_OBJECTS 64
+
+/*
+ * print_tables - write size_classes.h to stdout
+ */
+static void print_tables() {
+    std::printf("/*\n"
+                " * size_classes.h - generated by gen_size_classes from "
+                "size_class_spec.hpp.\n"
+                " * Do not edit; run \"make size_classes.h\" instead.\n"
+                " */\n\n");
+
+    std::printf("/* Sizes up to this many bytes are classified by one "
+                "lookup */\n");
+    std::printf("#define MM_CLASS_LOOKUP_LIMIT %zu\n\n", kLookupLimit);
+
+    std::printf("/* Size class of each size, indexed by size / "
+                "ALIGNMENT */\n");
+    std::printf("static const unsigned char mm_class_lookup[%zu] = {",
+                kLookupEntries);
+    for (std::size_t i = 0; i < kLookupEntries; i++)
+        std::printf("%s%u,", i % 16 ? " " : "\n  ", (unsigned)kLookup[i]);
+    std::printf("\n};\n\n");
+
+    std::printf("/* Largest payload of each size class */\n");
+    std::printf("static const size_t mm_class_max[%zu] = {", kNumClasses);
+    for (std::size_t c = 0; c < kNumClasses; c++)
+        std::printf("%s%zu,", c % 8 ? " " : "\n  ",
+                    mm::size_classes::class_max(c));
+    std::printf("\n};\n\n");
+
+    std::printf("/* Bytes of a slab holding objects of each size class */\n");
+    std::printf("static const size_t mm_class_slab[%zu] = {", kNumClasses);
+    for (std::size_t c = 0; c < kNumClasses; c++)
+        std::printf("%s%zu,", c % 8 ? " " : "\n  ", kSlabSize[c]);
+    std::printf("\n};\n");
+}
+
+/*
+ * read_sizes - append the ALIGNMENT-rounded size of every block a trace
+ *     asks mm for to sizes, in trace order; a batch or an arena counts
+ *     once per block it makes
+ */
+static void read_sizes(const char *path, std::vector<std::size_t> &sizes) {
+    trace_t *trace = trace_load(path);
+    std::size_t size;
+    int i, blocks;
+
+    for (i = 0; i < trace->num_ops; i++) {
+        const traceop_t &op = trace->ops[i];
+
+        switch (op.type) {
+        case traceop_t::ALLOC:
+        case traceop_t::REALLOC:
+        case traceop_t::CALLOC:
+        case traceop_t::MEMALIGN:
+            blocks = 1;
+            break;
+        case traceop_t::BATCH:
+            blocks = op.count;
+            break;
+        case traceop_t::ARENA:
+            /* Made twice over, with a reset between */
+            blocks = 2 * op.count;
+            break;
+        default:
+            blocks = 0;
+            break;
+        }
+        if (op.size <= 0)
+            continue;
+        size = ((std::size_t)op.size + MM_ALIGNMENT - 1) / MM_ALIGNMENT *
+               MM_ALIGNMENT;
+        sizes.insert(sizes.end(), blocks, size);
+    }
+    trace_free(trace);
+}
+
+/*
+ * replays - true if sizes[at..] is made up entirely of whole copies of
+ *     the size sequences of the traces in kept, back to back
+ */
+static bool replays(const std::vector<std::size_t> &sizes, std::size_t at,
+                    const std::vector<const std::vector<std::size_t> *> &kept) {
+    if (at == sizes.size())
+        return true;
+    for (const std::vector<std::size_t> *other : kept) {
+        if (other->empty() || other->size() > sizes.size() - at)
+            continue;
+        if (std::equal(other->begin(), other->end(), sizes.begin() + at) &&
+            replays(sizes, at + other->size(), kept))
+            return true;
+    }
+    return false;
+}
+
+/*
+ * profile - choose kNumClasses bounds over the sizes in the traces that
+ *     minimize the mean relative gap between a request and its class
+ *     bound, (class max - size) / size, and print them as a spec.
+ *     Weighting by size rather than bytes keeps small classes
+ *     fine-grained instead of spending every bound on the few largest
+ *     requests. A trace that only replays other traces (the same
+ *     requests with lifetime hints added, or several traces back to
+ *     back) is skipped so its requests are not counted twice.
+ */
+static void profile(int ntraces, char **traces) {
+    std::map<std::size_t, double> counts;
+    std::vector<std::vector<std::size_t>> sizes(ntraces);
+    std::vector<int> order(ntraces);
+    std::vector<const std::vector<std::size_t> *> kept;
+    std::vector<std::size_t> size;
+    std::vector<double> count, inverse;
+    std::size_t m, k, i, j;
+
+    for (int t = 0; t < ntraces; t++) {
+        read_sizes(traces[t], sizes[t]);
+        order[t] = t;
+    }
+
+    /* Shortest first, so every trace a replay is built from is already
+     * kept; try the longest candidates first when matching */
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+        return sizes[a].size() < sizes[b].size();
+    });
+    for (int t : order) {
+        if (!sizes[t].empty() && replays(sizes[t], 0, kept)) {
+            std::fprintf(stderr, "gen_size_classes: skipping %s, which only "
+                         "replays other traces\n", traces[t]);
+            continue;
+        }
+        kept.insert(kept.begin(), &sizes[t]);
+        for (std::size_t s : sizes[t])
+            counts[s]++;
+    }
+    if (counts.empty()) {
+        std::fprintf(stderr, "gen_size_classes: no allocations found\n");
+        std::exit(1);
+    }
+
+    /* Prefix sums over the distinct sizes: count[j] and inverse[j]
+     * cover sizes 0..j-1 */
+    count.push_back(0);
+    inverse.push_back(0);
+    for (auto &entry : counts) {
+        size.push_back(entry.first);
+        count.push_back(count.back() + entry.second);
+        inverse.push_back(inverse.back() + entry.second / entry.first);
+    }
+    m = size.size();
+
+    /* Relative gap of one class holding distinct sizes i..j */
+    auto cost = [&](std::size_t i, std::size_t j) {
+        return size[j] * (inverse[j + 1] - inverse[i]) -
+               (count[j + 1] - count[i]);
+    };
+
+    /* best[k][j]: least relative gap covering sizes 0..j with k+1
+     * classes; cut[k][j]: first size of the last of those classes */
+    std::size_t classes = m < kNumClasses ? m : kNumClasses;
+    const double inf = std::numeric_limits<double>::infinity();
+    std::vector<std::vector<double>> best(classes, std::vector<double>(m, inf));
+    std::vector<std::vector<std::size_t>> cut(classes,
+                                              std::vector<std::size_t>(m, 0));
+    for (j = 0; j < m; j++)
+        best[0][j] = cost(0, j);
+    for (k = 1; k < classes; k++) {
+        for (j = k; j < m; j++) {
+            for (i = k; i <= j; i++) {
+                double c = best[k - 1][i - 1] + cost(i, j);
+                if (c < best[k][j]) {
+                    best[k][j] = c;
+                    cut[k][j] = i;
+                }
+            }
+        }
+    }
+
+    /* Walk the cuts back to the class bounds */
+    std::vector<std::size_t> bounds(classes);
+    j = m - 1;
+    for (k = classes; k-- > 0;) {
+        bounds[k] = size[j];
+        if (k > 0)
+            j = cut[k][j] - 1;
+    }
+
+    /* Fewer distinct sizes than classes: double the last bound */
+    while (bounds.size() < kNumClasses)
+        bounds.push_back(bounds.back() * 2);
+
+    std::printf("/*\n"
+                " * size_class_spec.hpp - size-class bounds for "
+                "size_classes.hpp\n"
+                " *\n"
+                " * Generated by \"gen_size_classes -p\" from %zu traces "
+                "(%.0f requests).\n"
+                " * Mean gap between a request and its class bound: %.2f%% "
+                "of the request.\n"
+                " */\n",
+                kept.size(), count[m],
+                100.0 * best[classes - 1][m - 1] / count[m]);
+    std::printf("#ifndef MM_SIZE_CLASS_SPEC_HPP\n"
+                "#define MM_SIZE_CLASS_SPEC_HPP\n\n"
+                "#include <array>\n"
+                "#include <cstddef>\n\n"
+                "namespace mm {\n"
+                "namespace size_classes {\n"
+                "namespace spec {\n\n");
+    std::printf("/* Largest payload of each class; the last class also "
+                "takes everything larger */\n");
+    std::printf("constexpr std::array<std::size_t, %zu> kClassMax = {{",
+                kNumClasses);
+    for (k = 0; k < kNumClasses; k++)
+        std::printf("%s%zu%s", k % 8 ? " " : "\n    ", bounds[k],
+                    k + 1 < kNumClasses ? "," : "");
+    std::printf("\n}};\n\n");
+    std::printf("/* Objects of the largest size of a class that fit in "
+                "its slab */\n");
+    std::printf("constexpr std::size_t kSlabObjects = %d;\n\n", SLAB_OBJECTS);
+    std::printf("} // namespace spec\n"
+                "} // namespace size_classes\n"
+                "} // namespace mm\n\n"
+                "#endif /* MM_SIZE_CLASS_SPEC_HPP */\n");
+}
+
+int main(int argc, char **argv) {
+    if (argc == 1) {
+        print_tables();
+        return 0;
+    }
+    if (argc > 2 && std::strcmp(argv[1], "-p") == 0) {
+        profile(argc - 2, argv + 2);
+        return 0;
+    }
+
+    std::fprintf(stderr, "Usage: gen_size_classes [-p <trace>...]\n");
+    return 1;
+}
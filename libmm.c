@@ -0,0 +1,287 @@
+/*
+ * libmm.c - the C allocation interface on top of mm, built as libmm.so
+ *
+ * Run any dynamically linked program on the mm heap with
+ *
+ *     LD_PRELOAD=./libmm.so <program>
+ *
+ * and tune it with LIBMM_OPTS=name=value[,name=value...], using the
+ * mm_ctl knob names (e.g. LIBMM_OPTS=fastbin_max=64,grow_chunk=65536).
+ *
+ * mm is single-threaded, so every call holds one global lock. The heap is
+ * brought up by the first call. memlib is built over mmap for this
+ * library, so bringing it up does not allocate; anything that still calls
+ * back into malloc from inside mm (an assert message, pthread_atfork) is
+ * served from a small static bootstrap buffer that is never reused.
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memlib.h"
+#include "mm.h"
+
+/* libmm.so is built with -fvisibility=hidden; only these are exported */
+#define EXPORT __attribute__((visibility("default")))
+
+/* Largest request passed on to mm; keeps its size rounding from
+ * overflowing. */
+#define MAX_REQUEST (PTRDIFF_MAX / 2)
+
+/* Size of the bootstrap buffer, and of the header that records the size
+ * of each of its blocks. */
+#define BOOTSTRAP_SIZE (64 * 1024)
+#define BOOTSTRAP_HEADER 16
+
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+static int initialized = 0;
+
+/* Set while this thread is inside mm, so a nested call does not wait for
+ * the lock it already holds. */
+static __thread int in_mm __attribute__((tls_model("initial-exec")));
+
+static char bootstrap[BOOTSTRAP_SIZE] __attribute__((aligned(16)));
+static size_t bootstrap_used = 0;
+
+/* Bump-allocate size bytes from the bootstrap buffer. */
+static void* bootstrap_malloc(size_t size) {
+  size_t need = BOOTSTRAP_HEADER + ((size + 15) & ~(size_t)15);
+  size_t start = __atomic_fetch_add(&bootstrap_used, need, __ATOMIC_RELAXED);
+
+  if (size > BOOTSTRAP_SIZE || start + need > BOOTSTRAP_SIZE) {
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  *(size_t*)(bootstrap + start) = size;
+  return bootstrap + start + BOOTSTRAP_HEADER;
+}
+
+static int is_bootstrap(void* ptr) {
+  return (char*)ptr >= bootstrap && (char*)ptr < bootstrap + BOOTSTRAP_SIZE;
+}
+
+static size_t bootstrap_size(void* ptr) {
+  return *(size_t*)((char*)ptr - BOOTSTRAP_HEADER);
+}
+
+/* Apply the knobs listed in LIBMM_OPTS. Unknown names and malformed
+ * values are skipped. */
+static void apply_options(void) {
+  const char* opts = getenv("LIBMM_OPTS");
+  char name[64];
+  size_t len;
+  size_t value;
+  char* end;
+
+  while (opts && *opts) {
+    len = strcspn(opts, "=,");
+    if (opts[len] == '=' && len < sizeof(name)) {
+      memcpy(name, opts, len);
+      name[len] = '\0';
+      value = strtoul(opts + len + 1, &end, 0);
+      if (end != opts + len + 1 && (*end == ',' || *end == '\0')) {
+        mm_ctl(name, NULL, &value);
+      }
+    }
+
+    opts = strchr(opts, ',');
+    if (opts) {
+      opts++;
+    }
+  }
+}
+
+/* Hold the heap across fork so the child gets it in a consistent state. */
+static void fork_prepare(void) {
+  pthread_mutex_lock(&heap_lock);
+}
+
+static void fork_release(void) {
+  pthread_mutex_unlock(&heap_lock);
+}
+
+/* Take the heap lock, bringing the heap up on first use. Returns 0 for a
+ * nested call from inside mm, which must not touch the heap. */
+static int enter(void) {
+  if (in_mm) {
+    return 0;
+  }
+
+  pthread_mutex_lock(&heap_lock);
+  in_mm = 1;
+
+  if (!initialized) {
+    mem_init();
+    mm_init();
+    apply_options();
+    pthread_atfork(fork_prepare, fork_release, fork_release);
+    initialized = 1;
+  }
+
+  return 1;
+}
+
+static void leave(void) {
+  in_mm = 0;
+  pthread_mutex_unlock(&heap_lock);
+}
+
+EXPORT void* malloc(size_t size) {
+  void* ptr;
+
+  if (size > MAX_REQUEST) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  if (!enter()) {
+    return bootstrap_malloc(size);
+  }
+
+  // malloc(0) hands out a unique pointer, as glibc's does
+  ptr = mm_malloc(size ? size : 1);
+  leave();
+
+  if (ptr == NULL) {
+    errno = ENOMEM;
+  }
+  return ptr;
+}
+
+EXPORT void free(void* ptr) {
+  if (ptr == NULL || is_bootstrap(ptr)) {
+    return;
+  }
+  if (!enter()) {
+    // Nested free from inside mm: leak the block rather than recurse
+    return;
+  }
+
+  mm_free(ptr);
+  leave();
+}
+
+EXPORT void* calloc(size_t nmemb, size_t size) {
+  void* ptr;
+
+  if (size && nmemb > MAX_REQUEST / size) {
+    errno = ENOMEM;
+    return NULL;
+  }
+
+  ptr = malloc(nmemb * size);
+  if (ptr) {
+    // Blocks are recycled, so they have to be cleared
+    memset(ptr, 0, nmemb * size);
+  }
+  return ptr;
+}
+
+EXPORT void* realloc(void* ptr, size_t size) {
+  void* newPtr;
+
+  if (ptr && is_bootstrap(ptr)) {
+    // Move the block out of the bootstrap buffer
+    newPtr = malloc(size);
+    if (newPtr) {
+      memcpy(newPtr, ptr, bootstrap_size(ptr) < size ? bootstrap_size(ptr) : size);
+    }
+    return newPtr;
+  }
+  if (ptr == NULL || size == 0) {
+    // realloc(NULL, size) is malloc; realloc(ptr, 0) frees and, as with
+    // glibc, returns NULL
+    if (ptr == NULL) {
+      return malloc(size);
+    }
+    free(ptr);
+    return NULL;
+  }
+  if (size > MAX_REQUEST) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  if (!enter()) {
+    return NULL;
+  }
+
+  newPtr = mm_realloc(ptr, size);
+  leave();
+
+  if (newPtr == NULL) {
+    errno = ENOMEM;
+  }
+  return newPtr;
+}
+
+EXPORT void* reallocarray(void* ptr, size_t nmemb, size_t size) {
+  if (size && nmemb > MAX_REQUEST / size) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  return realloc(ptr, nmemb * size);
+}
+
+EXPORT int posix_memalign(void** memptr, size_t align, size_t size) {
+  void* ptr;
+
+  if (align < sizeof(void*) || (align & (align - 1))) {
+    return EINVAL;
+  }
+  if (size > MAX_REQUEST || align > MAX_REQUEST) {
+    return ENOMEM;
+  }
+  if (!enter()) {
+    return ENOMEM;
+  }
+
+  ptr = mm_memalign(align, size ? size : 1);
+  leave();
+
+  if (ptr == NULL) {
+    return ENOMEM;
+  }
+  *memptr = ptr;
+  return 0;
+}
+
+/* The other aligned entry points, so that nothing a program frees comes
+ * from glibc's heap. */
+EXPORT void* aligned_alloc(size_t align, size_t size) {
+  void* ptr;
+  int err = posix_memalign(&ptr, align < sizeof(void*) ? sizeof(void*) : align, size);
+
+  if (err) {
+    errno = err;
+    return NULL;
+  }
+  return ptr;
+}
+
+EXPORT void* memalign(size_t align, size_t size) {
+  return aligned_alloc(align, size);
+}
+
+EXPORT void* valloc(size_t size) {
+  return aligned_alloc(mem_pagesize(), size);
+}
+
+EXPORT void* pvalloc(size_t size) {
+  size_t page = mem_pagesize();
+
+  return aligned_alloc(page, (size + page - 1) & ~(page - 1));
+}
+
+EXPORT size_t malloc_usable_size(void* ptr) {
+  if (ptr == NULL) {
+    return 0;
+  }
+  if (is_bootstrap(ptr)) {
+    return bootstrap_size(ptr);
+  }
+
+  // Only reads the block's header, which is stable while it is allocated
+  return mm_usable_size(ptr);
+}
@@ -15,11 +15,17 @@
 #include <assert.h>
 #include <float.h>
 #include <time.h>
+#include <pthread.h>
+#include <sched.h>
 
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "ftimer.h"
+#include "clock.h"
 #include "config.h"
+#include "trace.h"
+#include "size_classes.h"
 
 /**********************
  * Constants and macros
@@ -30,9 +36,23 @@
 #define HDRLINES       4 /* number of header lines in a trace file */
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
 
+/* Tag written over realloc'd payloads, to check that their data moves */
+#define DATA_TAG(index) ((unsigned char)((index) & 0xFF))
+
 /* Returns true if p is ALIGNMENT-byte aligned */
 #define IS_ALIGNED(p)  ((((size_t)(p)) % ALIGNMENT) == 0)
 
+/* Most producer:consumer ratios -P takes */
+#define PC_MAX_RATIOS 16
+
+/* Byte written at both ends of a payload in streaming mode */
+#define STREAM_TAG(index) ((char)((index) * 131 + 7))
+
+/* Heap room per replay thread for a trace, as a multiple of its suggested
+ * heap size (its peak live payload bytes), for headers and fragmentation;
+ * never less than MAX_HEAP */
+#define HEAP_SLACK 2
+
 /******************************
  * The key compound data types
  *****************************/
@@ -44,24 +64,6 @@ typedef struct range_t {
     struct range_t *next;  /* next list element */
 } range_t;
 
-/* Characterizes a single trace operation (allocator request) */
-typedef struct {
-    enum {ALLOC, FREE} type; /* type of request */
-    int index;                        /* index for free() to use later */
-    int size;                         /* byte size of alloc request */
-} traceop_t;
-
-/* Holds the information for one trace file*/
-typedef struct {
-    int sugg_heapsize;   /* suggested heap size (unused) */
-    int num_ids;         /* number of alloc ids */
-    int num_ops;         /* number of distinct requests */
-    int weight;          /* weight for this trace (unused) */
-    traceop_t *ops;      /* array of requests */
-    char **blocks;       /* array of ptrs returned by malloc... */
-    size_t *block_sizes; /* ... and a corresponding array of payload sizes */
-} trace_t;
-
 /*
  * Holds the params to the xxx_speed functions, which are timed by fcyc.
  * This struct is necessary because fcyc accepts only a pointer array
@@ -72,6 +74,14 @@ typedef struct {
     range_t *ranges;
 } speed_t;
 
+/* Fragmentation snapshot gathered by walking the mm heap */
+typedef struct {
+    size_t alloc_bytes;   /* payload plus header bytes of allocated blocks */
+    size_t free_bytes;    /* payload bytes of free blocks */
+    size_t largest_free;  /* payload bytes of the largest free block */
+    int free_blocks;      /* number of free blocks */
+} frag_t;
+
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct {
     /* defined for both libc malloc and student malloc package (mm.c) */
@@ -81,6 +91,7 @@ typedef struct {
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
+    int weight;      /* the trace's weight in the perf index */
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t;
@@ -92,6 +103,25 @@ int verbose = 0;        /* global flag for verbose output */
 static int errors = 0;  /* number of errs found when running student malloc */
 char msg[MAXLINE];      /* for whenever we need to compose an error message */
 
+static int frag_interval = 0; /* sample fragmentation every n ops (-s) */
+static int stream_window = 0; /* stream traces in windows of n ops (-w) */
+static int op_timing = 0;     /* op latency histograms (-p) */
+static int num_threads = 0;   /* replay traces on n threads (-T) */
+static int scaling_threads = 0; /* scale from 1 to n threads (-S) */
+
+/* Simulated heap: room per replay thread the traces read so far want,
+ * room memlib has (0 before it is set up), and threads sharing it */
+static size_t heap_want = MAX_HEAP;
+static size_t heap_room = 0;
+static int heap_threads = 1;
+
+/* Producer:consumer ratios to run (-P) */
+static struct {
+    int producers;
+    int consumers;
+} pc_ratios[PC_MAX_RATIOS];
+static int num_pc_ratios = 0;
+
 /* Directory where default tracefiles are found */
 static char tracedir[MAXLINE] = TRACEDIR;
 
@@ -108,12 +138,14 @@ static char *default_tracefiles[] = {
 /* these functions manipulate range lists */
 static int add_range(range_t **ranges, char *lo, int size,
                      int tracenum, int opnum);
+static int check_payload(char *lo, int size, int tracenum, int opnum);
 static void remove_range(range_t **ranges, char *lo);
 static void clear_ranges(range_t **ranges);
 
 /* These functions read, allocate, and free storage for traces */
 static trace_t *read_trace(char *tracedir, char *filename);
 static void free_trace(trace_t *trace);
+static void size_heap(long sugg_heapsize);
 
 /* Routines for evaluating the correctness and speed of libc malloc */
 static int eval_libc_valid(trace_t *trace, int tracenum);
@@ -124,9 +156,28 @@ static void eval_libc_speed(void *ptr);
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
 static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
 static void eval_mm_speed(void *ptr);
+static void eval_mm_ops(trace_t *trace);
+static void print_op_table(void);
+static int eval_mm_stream(char *filename, int tracenum, stats_t *stats);
+static void eval_mm_stream_speed(void *ptr);
+static int replay_checked(const traceop_t *op, char **blocks,
+                          size_t *block_sizes, int tracenum, int opnum,
+                          long *total_size);
+static int eval_mm_threads(trace_t *trace, int tracenum, int threads,
+                           int shared, int report, stats_t *stats);
+static void eval_mm_scaling(char **tracefiles, int num_tracefiles);
+static void eval_mm_pc(char **tracefiles, int num_tracefiles);
+static void frag_visit(const mm_block_t *block, void *arg);
+static void sample_frag(int opnum, int total_size);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void set_mm_knob(char *arg);
+static void set_pc_ratios(char *arg);
+static void print_mm_stats(void);
+#ifdef MM_INSTRUMENT
+static void print_mm_instr(int tracenum);
+#endif
 static void usage(void);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
@@ -136,7 +187,7 @@ static void app_error(char *msg);
  * Main routine
  **************/
 int main(int argc, char **argv) {
-    int i;
+    int i, n;
     char c;
     char **tracefiles = NULL;  /* null-terminated array of trace file names */
     int num_tracefiles = 0;    /* the number of traces in that array */
@@ -151,12 +202,13 @@ int main(int argc, char **argv) {
 
     /* temporaries used to compute the performance index */
     double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
+    double weight, weights;
     int numcorrect;
 
     /*
      * Read and interpret the command line arguments
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgl")) != EOF) {
+    while ((c = getopt(argc, argv, "f:t:s:w:o:T:S:P:hvVglp")) != EOF) {
         switch (c) {
         case 'g': /* Generate summary info for the autograder */
             autograder = 1;
@@ -176,6 +228,43 @@ int main(int argc, char **argv) {
             if (tracedir[strlen(tracedir)-1] != '/')
                 strcat(tracedir, "/"); /* path always ends with "/" */
             break;
+        case 's': /* Sample fragmentation every n ops */
+            frag_interval = atoi(optarg);
+            if (frag_interval <= 0) {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'w': /* Stream traces in windows of n ops */
+            stream_window = atoi(optarg);
+            if (stream_window <= 0) {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'T': /* Replay traces on n threads */
+            num_threads = atoi(optarg);
+            if (num_threads <= 0) {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'S': /* Measure scaling from 1 to n threads */
+            scaling_threads = atoi(optarg);
+            if (scaling_threads <= 0) {
+                usage();
+                exit(1);
+            }
+            break;
+        case 'P': /* Producer/consumer runs: -P p:c[,p:c...] */
+            set_pc_ratios(optarg);
+            break;
+        case 'o': /* Set an mm knob: -o name=value */
+            set_mm_knob(optarg);
+            break;
+        case 'p': /* Record op latency histograms */
+            op_timing = 1;
+            break;
         case 'l': /* Run libc malloc */
             run_libc = 1;
             break;
@@ -194,6 +283,20 @@ int main(int argc, char **argv) {
         }
     }
 
+    /* libc and single ops are only measured on traces loaded whole */
+    if (stream_window && run_libc)
+        app_error("-l cannot be combined with -w");
+    if (stream_window && op_timing)
+        app_error("-p cannot be combined with -w");
+    if (num_threads && (stream_window || run_libc || op_timing || frag_interval))
+        app_error("-T cannot be combined with -w, -l, -p or -s");
+    if (scaling_threads && (num_threads || stream_window || run_libc ||
+                            op_timing || frag_interval))
+        app_error("-S cannot be combined with -T, -w, -l, -p or -s");
+    if (num_pc_ratios && (scaling_threads || num_threads || stream_window ||
+                          run_libc || op_timing || frag_interval))
+        app_error("-P cannot be combined with -S, -T, -w, -l, -p or -s");
+
     /*
      * If no -f command line arg, then use the entire set of tracefiles
      * defined in default_traces[]
@@ -253,12 +356,52 @@ int main(int argc, char **argv) {
     if (mm_stats == NULL)
         unix_error("mm_stats calloc in main failed");
 
-    /* Initialize the simulated memory system in memlib.c */
-    mem_init();
+    /* Initialize the simulated memory system in memlib.c, with a heap's
+     * worth of room for each replay thread; size_heap grows it for larger
+     * traces */
+    for (i = 0, n = num_threads + scaling_threads; i < num_pc_ratios; i++)
+        if (pc_ratios[i].producers + pc_ratios[i].consumers > n)
+            n = pc_ratios[i].producers + pc_ratios[i].consumers;
+    heap_threads = n ? n : 1;
+    mem_init_heap(heap_want * heap_threads);
+    heap_room = heap_want;
+
+    /* Scaling and producer/consumer runs print their own tables instead
+     * of a perf index */
+    if (scaling_threads || num_pc_ratios) {
+        if (scaling_threads)
+            eval_mm_scaling(tracefiles, num_tracefiles);
+        else
+            eval_mm_pc(tracefiles, num_tracefiles);
+        if (errors)
+            printf("Terminated with %d errors\n", errors);
+        exit(errors != 0);
+    }
 
     /* Evaluate student's mm malloc package using the K-best scheme */
     for (i = 0; i < num_tracefiles; i++) {
+        if (stream_window) {
+            /* Too large to load: check, measure and time it in windows */
+            if (verbose > 1)
+                printf("Streaming tracefile: %s\n", tracefiles[i]);
+            mm_stats[i].valid = eval_mm_stream(tracefiles[i], i, &mm_stats[i]);
+            if (mm_stats[i].valid && verbose > 1)
+                print_mm_stats();
+            continue;
+        }
+
         trace = read_trace(tracedir, tracefiles[i]);
+        mm_stats[i].weight = trace->weight;
+        if (num_threads) {
+            /* Check, measure and time it on num_threads threads */
+            if (verbose > 1)
+                printf("Replaying on %d threads.\n", num_threads);
+            mm_stats[i].valid = eval_mm_threads(trace, i, num_threads,
+                                                (trace->flags & TRACE_TIDS) != 0,
+                                                1, &mm_stats[i]);
+            free_trace(trace);
+            continue;
+        }
         mm_stats[i].ops = trace->num_ops;
         if (verbose > 1)
             printf("Checking mm_malloc for correctness, ");
@@ -267,11 +410,18 @@ int main(int argc, char **argv) {
             if (verbose > 1)
                 printf("efficiency, ");
             mm_stats[i].util = eval_mm_util(trace, i, &ranges);
+#ifdef MM_INSTRUMENT
+            print_mm_instr(i);
+#endif
             speed_params.trace = trace;
             speed_params.ranges = ranges;
             if (verbose > 1)
                 printf("and performance.\n");
             mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
+            if (op_timing)
+                eval_mm_ops(trace);
+            if (verbose > 1)
+                print_mm_stats();
         }
         free_trace(trace);
     }
@@ -282,22 +432,33 @@ int main(int argc, char **argv) {
         printresults(num_tracefiles, mm_stats);
         printf("\n");
     }
+    if (op_timing)
+        print_op_table();
 
     /*
-     * Accumulate the aggregate statistics for the student's mm package
+     * Accumulate the aggregate statistics for the student's mm package,
+     * each trace counting as often as its header's weight says. A trace
+     * of weight 0 is checked but left out, unless all of them are.
      */
+    weights = 0;
+    for (i = 0; i < num_tracefiles; i++)
+        weights += (mm_stats[i].weight > 0) ? mm_stats[i].weight : 0;
     secs = 0;
     ops = 0;
     util = 0;
     numcorrect = 0;
     for (i = 0; i < num_tracefiles; i++) {
-        secs += mm_stats[i].secs;
-        ops += mm_stats[i].ops;
-        util += mm_stats[i].util;
+        if (weights > 0)
+            weight = (mm_stats[i].weight > 0) ? mm_stats[i].weight : 0;
+        else
+            weight = 1;
+        secs += weight * mm_stats[i].secs;
+        ops += weight * mm_stats[i].ops;
+        util += weight * mm_stats[i].util;
         if (mm_stats[i].valid)
             numcorrect++;
     }
-    avg_mm_util = util/num_tracefiles;
+    avg_mm_util = util / (weights > 0 ? weights : num_tracefiles);
 
     /*
      * Compute and print the performance index
@@ -339,19 +500,13 @@ int main(int argc, char **argv) {
  ****************************************************************/
 
 /*
- * add_range - As directed by request opnum in trace tracenum,
- *     we've just called the student's mm_malloc to allocate a block of
- *     size bytes at addr lo. After checking the block for correctness,
- *     we create a range struct for this block and add it to the range list.
+ * check_payload - Check that the payload at lo is ALIGNMENT-byte aligned
+ *     and lies within the heap. Returns 0 (and reports an error) if not.
  */
-static int add_range(range_t **ranges, char *lo, int size,
-                     int tracenum, int opnum) {
+static int check_payload(char *lo, int size, int tracenum, int opnum) {
     char *hi = lo + size - 1;
-    range_t *p;
     char msg[MAXLINE];
 
-    assert(size > 0);
-
     /* Payload addresses must be ALIGNMENT-byte aligned */
     if (!IS_ALIGNED(lo)) {
         examine_heap();
@@ -371,6 +526,27 @@ static int add_range(range_t **ranges, char *lo, int size,
         return 0;
     }
 
+    return 1;
+}
+
+/*
+ * add_range - As directed by request opnum in trace tracenum,
+ *     we've just called the student's mm_malloc to allocate a block of
+ *     size bytes at addr lo. After checking the block for correctness,
+ *     we create a range struct for this block and add it to the range list.
+ */
+static int add_range(range_t **ranges, char *lo, int size,
+                     int tracenum, int opnum) {
+    char *hi = lo + size - 1;
+    range_t *p;
+    char msg[MAXLINE];
+
+    assert(size > 0);
+
+    /* The payload must be aligned and inside the heap */
+    if (!check_payload(lo, size, tracenum, opnum))
+        return 0;
+
     /* The payload must not overlap any other payloads */
     for (p = *ranges;  p != NULL;  p = p->next) {
         if ((lo >= p->lo && lo <= p-> hi) ||
@@ -435,91 +611,50 @@ static void clear_ranges(range_t **ranges) {
  *********************************************/
 
 /*
- * read_trace - read a trace file and store it in memory
+ * read_trace - read a trace file, text or binary (see trace.h), and
+ *     store it in memory
  */
 static trace_t *read_trace(char *tracedir, char *filename) {
-    FILE *tracefile;
     trace_t *trace;
-    char type[MAXLINE];
     char path[MAXLINE];
-    unsigned index, size;
-    unsigned max_index = 0;
-    unsigned op_index;
 
     if (verbose > 1)
         printf("Reading tracefile: %s\n", filename);
 
-    /* Allocate the trace record */
-    if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
-        unix_error("malloc 1 failed in read_trance");
-
-    /* Read the trace file header */
     strcpy(path, tracedir);
     strcat(path, filename);
-    if ((tracefile = fopen(path, "r")) == NULL) {
+    if ((trace = trace_load(path)) == NULL) {
         sprintf(msg, "Could not open %s in read_trace", path);
         unix_error(msg);
     }
-    fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
-    fscanf(tracefile, "%d", &(trace->num_ids));
-    fscanf(tracefile, "%d", &(trace->num_ops));
-    fscanf(tracefile, "%d", &(trace->weight));        /* not used */
-
-    /* We'll store each request line in the trace in this array */
-    if ((trace->ops =
-         (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
-        unix_error("malloc 2 failed in read_trace");
-
-    /* We'll keep an array of pointers to the allocated blocks here... */
-    if ((trace->blocks =
-         (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
-        unix_error("malloc 3 failed in read_trace");
-
-    /* ... along with the corresponding byte sizes of each block */
-    if ((trace->block_sizes =
-         (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
-        unix_error("malloc 4 failed in read_trace");
-
-    /* read every request line in the trace file */
-    index = 0;
-    op_index = 0;
-    while (fscanf(tracefile, "%s", type) != EOF) {
-        switch (type[0]) {
-        case 'a':
-            fscanf(tracefile, "%u %u", &index, &size);
-            trace->ops[op_index].type = ALLOC;
-            trace->ops[op_index].index = index;
-            trace->ops[op_index].size = size;
-            max_index = (index > max_index) ? index : max_index;
-            break;
-        case 'f':
-            fscanf(tracefile, "%ud", &index);
-            trace->ops[op_index].type = FREE;
-            trace->ops[op_index].index = index;
-            break;
-        default:
-            printf("Bogus type character (%c) in tracefile %s\n",
-                   type[0], path);
-            exit(1);
-        }
-        op_index++;
-    }
-    fclose(tracefile);
-    assert(max_index == trace->num_ids - 1);
-    assert(trace->num_ops == op_index);
+    size_heap(trace->sugg_heapsize);
 
     return trace;
 }
 
 /*
- * free_trace - Free the trace record and the three arrays it points
- *              to, all of which were allocated in read_trace().
+ * size_heap - make room in the simulated heap for a trace with the given
+ *     suggested heap size. Once memlib is set up, growing it starts a
+ *     new, empty heap, so call this before mm_init.
+ */
+static void size_heap(long sugg_heapsize) {
+    if (sugg_heapsize > 0 && (size_t)sugg_heapsize * HEAP_SLACK > heap_want)
+        heap_want = (size_t)sugg_heapsize * HEAP_SLACK;
+
+    if (heap_room && heap_want > heap_room) {
+        if (verbose > 1)
+            printf("Growing the heap to %zu bytes per thread\n", heap_want);
+        mem_deinit();
+        mem_init_heap(heap_want * heap_threads);
+        heap_room = heap_want;
+    }
+}
+
+/*
+ * free_trace - Free the trace record and the arrays it points to
  */
 void free_trace(trace_t *trace) {
-    free(trace->ops);         /* free the three arrays... */
-    free(trace->blocks);
-    free(trace->block_sizes);
-    free(trace);              /* and the trace record itself... */
+    trace_free(trace);
 }
 
 /**********************************************************************
@@ -527,14 +662,194 @@ void free_trace(trace_t *trace) {
  * and throughput of the libc and mm malloc packages.
  **********************************************************************/
 
+/*
+ * The op table. Each trace op type has a row giving what the op does to
+ * the blocks it names and how to replay it on mm and on libc; the eval_
+ * routines below are written against the table only. To benchmark a new
+ * mm entry point, give it an op type in trace.h and a row here.
+ *
+ * A replay function gets the op, the block it consumes (for OP_OLD
+ * rows, else NULL) and where to store the blocks it makes: one for most
+ * ops, op->count for a batch, at consecutive ids from op->index. It
+ * returns 0 if the allocator failed. An arena op makes and consumes no
+ * blocks the driver can see, so it checks its objects itself.
+ */
+#define OP_NEW 0x1      /* makes blocks, which the driver checks */
+#define OP_OLD 0x2      /* consumes the block op->index */
+
+typedef int (*replay_fn)(const traceop_t *op, char *old, char **blocks);
+
+typedef struct {
+    char *name;         /* the mm call, for messages */
+    int flags;          /* OP_NEW, OP_OLD */
+    replay_fn mm;       /* replays the op on mm */
+    replay_fn libc;     /* replays the op on libc */
+} opdesc_t;
+
+/* Blocks made by op, or named by it if it makes none */
+#define NEW_BLOCKS(op) \
+    ((op)->type == BATCH ? (op)->count : (op)->type == ARENA ? 0 : 1)
+
+static int mm_alloc_op(const traceop_t *op, char *old, char **blocks) {
+    blocks[0] = op->hint ? mm_malloc_hint(op->size, op->hint)
+                         : mm_malloc(op->size);
+    return blocks[0] != NULL;
+}
+
+/* mm has no calloc; libmm clears an mm_malloc'd block the same way */
+static int mm_calloc_op(const traceop_t *op, char *old, char **blocks) {
+    if ((blocks[0] = mm_malloc(op->size)) == NULL)
+        return 0;
+    memset(blocks[0], 0, op->size);
+    return 1;
+}
+
+static int mm_memalign_op(const traceop_t *op, char *old, char **blocks) {
+    return (blocks[0] = mm_memalign(op->align, op->size)) != NULL;
+}
+
+static int mm_realloc_op(const traceop_t *op, char *old, char **blocks) {
+    return (blocks[0] = mm_realloc(old, op->size)) != NULL;
+}
+
+static int mm_free_op(const traceop_t *op, char *old, char **blocks) {
+    mm_free(old);
+    return 1;
+}
+
+static int mm_batch_op(const traceop_t *op, char *old, char **blocks) {
+    return mm_malloc_batch(op->size, (void **)blocks, op->count) == op->count;
+}
+
+static int mm_free_sized_op(const traceop_t *op, char *old, char **blocks) {
+    mm_free_sized(old, op->size);
+    return 1;
+}
+
+/*
+ * mm_arena_op - Make op->count objects in a new arena, reset it and make
+ *   them again, then destroy it. Each object must be aligned and in the
+ *   heap, and the tags at both of its ends must survive until the reset,
+ *   so objects that overlap fail.
+ */
+static int mm_arena_op(const traceop_t *op, char *old, char **blocks) {
+    mm_arena_t *arena;
+    char **objs;
+    char *p;
+    int i, round, ok = 1;
+
+    if ((objs = (char **)malloc(op->count * sizeof(char *))) == NULL)
+        unix_error("malloc failed in mm_arena_op");
+    if ((arena = mm_arena_create()) == NULL) {
+        free(objs);
+        return 0;
+    }
+
+    for (round = 0; round < 2 && ok; round++) {
+        for (i = 0; i < op->count && ok; i++) {
+            p = objs[i] = mm_arena_malloc(arena, op->size);
+            ok = p != NULL && IS_ALIGNED(p) &&
+                 p >= (char *)mem_heap_lo() &&
+                 p + op->size - 1 <= (char *)mem_heap_hi();
+            if (ok)
+                p[0] = p[op->size - 1] = STREAM_TAG(i);
+        }
+        for (i = 0; i < op->count && ok; i++)
+            ok = objs[i][0] == STREAM_TAG(i) &&
+                 objs[i][op->size - 1] == STREAM_TAG(i);
+        mm_arena_reset(arena);
+    }
+
+    mm_arena_destroy(arena);
+    free(objs);
+    return ok;
+}
+
+static int libc_alloc_op(const traceop_t *op, char *old, char **blocks) {
+    return (blocks[0] = malloc(op->size)) != NULL;
+}
+
+static int libc_calloc_op(const traceop_t *op, char *old, char **blocks) {
+    return (blocks[0] = calloc(1, op->size)) != NULL;
+}
+
+static int libc_memalign_op(const traceop_t *op, char *old, char **blocks) {
+    size_t align = op->align < sizeof(void *) ? sizeof(void *) : op->align;
+
+    return posix_memalign((void **)blocks, align, op->size) == 0;
+}
+
+static int libc_realloc_op(const traceop_t *op, char *old, char **blocks) {
+    return (blocks[0] = realloc(old, op->size)) != NULL;
+}
+
+static int libc_free_op(const traceop_t *op, char *old, char **blocks) {
+    free(old);
+    return 1;
+}
+
+static int libc_batch_op(const traceop_t *op, char *old, char **blocks) {
+    int i;
+
+    for (i = 0; i < op->count; i++)
+        if ((blocks[i] = malloc(op->size)) == NULL)
+            return 0;
+    return 1;
+}
+
+/* libc has no arenas; make the objects and free them one by one */
+static int libc_arena_op(const traceop_t *op, char *old, char **blocks) {
+    char **objs;
+    int i, round, ok = 1;
+
+    if ((objs = (char **)malloc(op->count * sizeof(char *))) == NULL)
+        unix_error("malloc failed in libc_arena_op");
+
+    for (round = 0; round < 2; round++) {
+        for (i = 0; i < op->count; i++)
+            ok &= (objs[i] = malloc(op->size)) != NULL;
+        for (i = 0; i < op->count; i++)
+            free(objs[i]);
+    }
+
+    free(objs);
+    return ok;
+}
+
+static opdesc_t op_table[] = {
+    [ALLOC]      = {"malloc",     OP_NEW,          mm_alloc_op,      libc_alloc_op},
+    [FREE]       = {"free",       OP_OLD,          mm_free_op,       libc_free_op},
+    [REALLOC]    = {"realloc",    OP_NEW | OP_OLD, mm_realloc_op,    libc_realloc_op},
+    [CALLOC]     = {"calloc",     OP_NEW,          mm_calloc_op,     libc_calloc_op},
+    [MEMALIGN]   = {"memalign",   OP_NEW,          mm_memalign_op,   libc_memalign_op},
+    [BATCH]      = {"batch",      OP_NEW,          mm_batch_op,      libc_batch_op},
+    [FREE_SIZED] = {"free_sized", OP_OLD,          mm_free_sized_op, libc_free_op},
+    [ARENA]      = {"arena",      0,               mm_arena_op,      libc_arena_op},
+};
+
+/*
+ * replay - Replay op on mm or (if libc) on libc against the block table
+ *   of trace. Returns 0 if the allocator failed.
+ */
+static inline int replay(trace_t *trace, const traceop_t *op, int libc) {
+    opdesc_t *desc = &op_table[op->type];
+    char *old = (desc->flags & OP_OLD) ? trace->blocks[op->index] : NULL;
+
+    return libc ? desc->libc(op, old, &trace->blocks[op->index])
+                : desc->mm(op, old, &trace->blocks[op->index]);
+}
+
 /*
  * eval_mm_valid - Check the mm malloc package for correctness
  */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) {
-    int i;
+    int i, j, k;
     int index;
     int size;
-    char *p;
+    int oldsize = 0;
+    traceop_t *op;
+    opdesc_t *desc;
+    char *p, *oldp = NULL;
 
     /* Reset the heap and free any records in the range list */
     mem_reset_brk();
@@ -548,15 +863,33 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) {
 
     /* Interpret each operation in the trace in order */
     for (i = 0;  i < trace->num_ops;  i++) {
-        index = trace->ops[i].index;
-        size = trace->ops[i].size;
-
-        switch (trace->ops[i].type) {
-        case ALLOC: /* mm_malloc */
+        op = &trace->ops[i];
+        desc = &op_table[op->type];
+        index = op->index;
+        size = op->size;
+
+        /* Remove the block the op consumes from the range list */
+        if (desc->flags & OP_OLD) {
+            oldp = trace->blocks[index];
+            oldsize = trace->block_sizes[index];
+            remove_range(ranges, oldp);
+        }
 
-            /* Call the student's malloc */
-            if ((p = mm_malloc(size)) == NULL) {
-                malloc_error(tracenum, i, "mm_malloc failed.");
+        /* Call the student's malloc, free, ... */
+        if (!desc->mm(op, oldp, &trace->blocks[index])) {
+            sprintf(msg, "mm_%s failed.", desc->name);
+            malloc_error(tracenum, i, msg);
+            return 0;
+        }
+        if (!(desc->flags & OP_NEW))
+            continue;
+
+        for (j = index; j < index + NEW_BLOCKS(op); j++) {
+            p = trace->blocks[j];
+            if (op->type == MEMALIGN &&
+                (size_t)p % (size_t)op->align != 0) {
+                sprintf(msg, "mm_%s block misaligned.", desc->name);
+                malloc_error(tracenum, i, msg);
                 return 0;
             }
 
@@ -568,28 +901,27 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) {
             if (add_range(ranges, p, size, tracenum, i) == 0)
                 return 0;
 
+            /* A resized block must start with the data of the old one */
+            if (desc->flags & OP_OLD) {
+                for (k = 0; k < oldsize && k < size; k++) {
+                    if ((unsigned char)p[k] != DATA_TAG(j)) {
+                        sprintf(msg, "mm_%s did not preserve the data from "
+                                "old block", desc->name);
+                        malloc_error(tracenum, i, msg);
+                        return 0;
+                    }
+                }
+            }
+
             /* ADDED: cgw
              * fill range with low byte of index.  This will be used later
              * if we realloc the block and wish to make sure that the old
              * data was copied to the new block
              */
-            memset(p, index & 0xFF, size);
+            memset(p, DATA_TAG(j), size);
 
             /* Remember region */
-            trace->blocks[index] = p;
-            trace->block_sizes[index] = size;
-            break;
-
-        case FREE: /* mm_free */
-
-            /* Remove region from list and call student's free function */
-            p = trace->blocks[index];
-            remove_range(ranges, p);
-            mm_free(p);
-            break;
-
-        default:
-            app_error("Nonexistent request type in eval_mm_valid");
+            trace->block_sizes[j] = size;
         }
     }
 
@@ -604,74 +936,110 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) {
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the
  *   size of the heap in bytes after running the student's malloc
- *   package on the trace. Note that our implementation of mem_sbrk()
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap.
+ *   package on the trace. Since mm_ctl("trim_threshold") lets the
+ *   package give memory back through mem_trim(), heapsize is the high
+ *   water mark of the brk pointer rather than its final value.
  */
 static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges) {
-    int i;
-    int index;
-    int size;
+    int i, j;
     int max_total_size = 0;
     int total_size = 0;
-    char *p;
+    traceop_t *op;
+    opdesc_t *desc;
 
     /* initialize the heap and the mm malloc package */
     mem_reset_brk();
     if (mm_init() < 0)
         app_error("mm_init failed in eval_mm_util");
 
+    if (frag_interval) {
+        printf("\ntrace %d fragmentation:\n", tracenum);
+        printf("%8s%10s%10s%10s%8s%10s%8s\n", "op", "live", "free",
+               "largest", "lg/free", "blocks", "intfrag");
+    }
+
     for (i = 0;  i < trace->num_ops;  i++) {
-        switch (trace->ops[i].type) {
-        case ALLOC: /* mm_alloc */
-            index = trace->ops[i].index;
-            size = trace->ops[i].size;
+        op = &trace->ops[i];
+        desc = &op_table[op->type];
 
-            if ((p = mm_malloc(size)) == NULL)
-                app_error("mm_malloc failed in eval_mm_util");
+        /* Keep track of current total size
+         * of all allocated blocks */
+        if (desc->flags & OP_OLD)
+            total_size -= trace->block_sizes[op->index];
 
-            /* Remember region and size */
-            trace->blocks[index] = p;
-            trace->block_sizes[index] = size;
+        if (!replay(trace, op, 0)) {
+            sprintf(msg, "mm_%s failed in eval_mm_util", desc->name);
+            app_error(msg);
+        }
 
-            /* Keep track of current total size
-             * of all allocated blocks */
-            total_size += size;
+        /* Remember the sizes of the new blocks */
+        if (desc->flags & OP_NEW) {
+            for (j = op->index; j < op->index + NEW_BLOCKS(op); j++) {
+                trace->block_sizes[j] = op->size;
+                total_size += op->size;
+            }
+        }
 
-            /* Update statistics */
-            max_total_size = (total_size > max_total_size) ?
-                total_size : max_total_size;
-            break;
+        /* Update statistics */
+        max_total_size = (total_size > max_total_size) ?
+            total_size : max_total_size;
 
-        case FREE: /* mm_free */
-            index = trace->ops[i].index;
-            size = trace->block_sizes[index];
-            p = trace->blocks[index];
+        if (frag_interval && ((i + 1) % frag_interval == 0 ||
+                              i + 1 == trace->num_ops))
+            sample_frag(i + 1, total_size);
+    }
 
-            mm_free(p);
+    return ((double)max_total_size / (double)mem_peak_heapsize());
+}
 
-            /* Keep track of current total size
-             * of all allocated blocks */
-            total_size -= size;
 
-            break;
+/*
+ * frag_visit - mm_heap_walk callback that accumulates a frag_t
+ */
+static void frag_visit(const mm_block_t *block, void *arg) {
+    frag_t *frag = (frag_t *)arg;
 
-        default:
-            app_error("Nonexistent request type in eval_mm_util");
-        }
+    if (block->allocated) {
+        frag->alloc_bytes += block->size + block->overhead;
+    } else {
+        frag->free_bytes += block->size;
+        frag->free_blocks++;
+        if (block->size > frag->largest_free)
+            frag->largest_free = block->size;
     }
-
-    return ((double)max_total_size / (double)mem_heapsize());
 }
 
+/*
+ * sample_frag - Walk the mm heap after opnum ops and print how much
+ *   memory is lost to external fragmentation (free space split across
+ *   blocks, so the largest free block is only part of the free total)
+ *   and to internal fragmentation (ALIGNMENT rounding and headers on top
+ *   of the total_size bytes the trace asked for).
+ */
+static void sample_frag(int opnum, int total_size) {
+    frag_t frag = {0, 0, 0, 0};
+    size_t intfrag;
+
+    mm_heap_walk(frag_visit, &frag);
+    intfrag = frag.alloc_bytes - total_size;
+
+    printf("%8d%10d%10lu%10lu%7.0f%%%10d%7.0f%%\n",
+           opnum,
+           total_size,
+           (unsigned long)frag.free_bytes,
+           (unsigned long)frag.largest_free,
+           frag.free_bytes ?
+               100.0 * frag.largest_free / frag.free_bytes : 100.0,
+           frag.free_blocks,
+           frag.alloc_bytes ? 100.0 * intfrag / frag.alloc_bytes : 0.0);
+}
 
 /*
  * eval_mm_speed - This is the function that is used by fcyc()
  *    to measure the running time of the mm malloc package.
  */
 static void eval_mm_speed(void *ptr) {
-    int i, index, size;
-    char *p, *block;
+    int i;
     trace_t *trace = ((speed_t *)ptr)->trace;
 
     /* Reset the heap and initialize the mm package */
@@ -681,24 +1049,1090 @@ static void eval_mm_speed(void *ptr) {
 
     /* Interpret each trace request */
     for (i = 0;  i < trace->num_ops;  i++)
-        switch (trace->ops[i].type) {
-        case ALLOC: /* mm_malloc */
-            index = trace->ops[i].index;
-            size = trace->ops[i].size;
-            if ((p = mm_malloc(size)) == NULL)
-                app_error("mm_malloc error in eval_mm_speed");
-            trace->blocks[index] = p;
+        if (!replay(trace, &trace->ops[i], 0))
+            app_error("mm op failed in eval_mm_speed");
+}
+
+/*
+ * Latency histograms (-p). Each op's cycles go into a log-linear
+ * histogram, HDR-style: values below HIST_SUB are counted exactly, and
+ * each power of two above that is split into HIST_SUB equal buckets, so
+ * a bucket is never wider than 1/HIST_SUB of the values in it. There is
+ * one histogram per op type and mm size class, by the size the op asks
+ * for (for a free, that of its block).
+ */
+#define HIST_SUB_BITS 4
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((65 - HIST_SUB_BITS) * HIST_SUB)
+
+typedef struct {
+    unsigned long count;
+    unsigned long long sum;
+    unsigned long long max;
+    unsigned long buckets[HIST_BUCKETS];
+} hist_t;
+
+static hist_t op_hist[ARENA + 1][MM_NUM_SIZE_CLASSES];
+
+/* Bucket of v: v itself below HIST_SUB, else shift * HIST_SUB plus the
+ * top HIST_SUB_BITS + 1 bits of v, for v shifted right by shift */
+static inline int hist_bucket(unsigned long long v) {
+    int shift;
+
+    if (v < HIST_SUB)
+        return v;
+    shift = 63 - __builtin_clzll(v) - HIST_SUB_BITS;
+    return shift * HIST_SUB + (int)(v >> shift);
+}
+
+/* Largest value that falls in bucket b */
+static unsigned long long hist_bucket_max(int b) {
+    int shift;
+
+    if (b < HIST_SUB)
+        return b;
+    shift = b / HIST_SUB - 1;
+    return ((unsigned long long)(b - shift * HIST_SUB + 1) << shift) - 1;
+}
+
+static inline void hist_add(hist_t *h, unsigned long long v) {
+    h->count++;
+    h->sum += v;
+    if (v > h->max)
+        h->max = v;
+    h->buckets[hist_bucket(v)]++;
+}
+
+static void hist_merge(hist_t *into, const hist_t *h) {
+    int b;
+
+    into->count += h->count;
+    into->sum += h->sum;
+    if (h->max > into->max)
+        into->max = h->max;
+    for (b = 0; b < HIST_BUCKETS; b++)
+        into->buckets[b] += h->buckets[b];
+}
+
+/* Value at quantile q of h: the top of the bucket that holds it, but no
+ * more than the largest value seen */
+static unsigned long long hist_quantile(const hist_t *h, double q) {
+    unsigned long rank = (unsigned long)(q * h->count + 0.999999);
+    unsigned long seen = 0;
+    int b;
+
+    if (rank == 0)
+        rank = 1;
+    for (b = 0; b < HIST_BUCKETS; b++)
+        if ((seen += h->buckets[b]) >= rank)
             break;
+    return hist_bucket_max(b) < h->max ? hist_bucket_max(b) : h->max;
+}
+
+/* mm size class of a request of size bytes */
+static int size_class_of(size_t size) {
+    int c;
 
-        case FREE: /* mm_free */
-            index = trace->ops[i].index;
-            block = trace->blocks[index];
-            mm_free(block);
+    for (c = 0; c < MM_NUM_SIZE_CLASSES - 1; c++)
+        if (size <= mm_class_max[c])
             break;
+    return c;
+}
 
-        default:
-            app_error("Nonexistent request type in eval_mm_valid");
+/*
+ * eval_mm_ops - Replay the trace once more, timing each op with the
+ *   cycle counter into op_hist (-p). The counter's own overhead is in
+ *   every sample; print_op_table reports it.
+ */
+static void eval_mm_ops(trace_t *trace) {
+    int i, j, size;
+    traceop_t *op;
+    opdesc_t *desc;
+    unsigned long long start, cycles;
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+        app_error("mm_init failed in eval_mm_ops");
+
+    for (i = 0;  i < trace->num_ops;  i++) {
+        op = &trace->ops[i];
+        desc = &op_table[op->type];
+        size = (desc->flags == OP_OLD) ? trace->block_sizes[op->index]
+                                       : op->size;
+
+        start = read_counter();
+        if (!replay(trace, op, 0))
+            app_error("mm op failed in eval_mm_ops");
+        cycles = read_counter() - start;
+        hist_add(&op_hist[op->type][size_class_of(size)], cycles);
+
+        if (desc->flags & OP_NEW)
+            for (j = op->index; j < op->index + NEW_BLOCKS(op); j++)
+                trace->block_sizes[j] = op->size;
+    }
+}
+
+static void print_hist_row(const char *name, const char *class,
+                           const hist_t *h) {
+    printf("%-10s%8s%10lu%8.0f%8llu%8llu%8llu%10llu\n", name, class, h->count,
+           (double)h->sum / h->count, hist_quantile(h, 0.5),
+           hist_quantile(h, 0.99), hist_quantile(h, 0.999), h->max);
+}
+
+/*
+ * print_op_table - Print the latency of the ops replayed by eval_mm_ops,
+ *   by type and, under each type, by size class (up to the largest
+ *   request in the class)
+ */
+static void print_op_table(void) {
+    unsigned long long start, ovhd = ~0ULL;
+    hist_t all;
+    char class[32];
+    int i, c;
+
+    /* The cheapest back-to-back reads of the counter */
+    for (i = 0; i < 1000; i++) {
+        start = read_counter();
+        if (read_counter() - start < ovhd)
+            ovhd = read_counter() - start;
+    }
+
+    printf("\nmm op latency in cycles (%llu of them the counter's):\n", ovhd);
+    printf("%-10s%8s%10s%8s%8s%8s%8s%10s\n", "op", "size", "count", "mean",
+           "p50", "p99", "p99.9", "max");
+    for (i = 0; i < sizeof(op_table) / sizeof(op_table[0]); i++) {
+        memset(&all, 0, sizeof(all));
+        for (c = 0; c < MM_NUM_SIZE_CLASSES; c++)
+            hist_merge(&all, &op_hist[i][c]);
+        if (all.count == 0)
+            continue;
+
+        print_hist_row(op_table[i].name, "all", &all);
+        for (c = 0; c < MM_NUM_SIZE_CLASSES; c++) {
+            if (op_hist[i][c].count == 0)
+                continue;
+            if (c == MM_NUM_SIZE_CLASSES - 1)
+                sprintf(class, ">%lu", (unsigned long)mm_class_max[c - 1]);
+            else
+                sprintf(class, "<=%lu", (unsigned long)mm_class_max[c]);
+            print_hist_row("", class, &op_hist[i][c]);
+        }
+    }
+}
+
+/*
+ * replay_checked - Replay op on mm against the block table blocks, as
+ *   checked by eval_mm_stream and the threaded replay. The range list
+ *   costs O(live blocks) per op, so instead each payload is checked for
+ *   alignment and heap bounds, and tagged at both ends with a byte derived
+ *   from its id that must still be there when it is consumed. Keeps
+ *   *total_size, the payload bytes live. Returns 0 (and reports an error)
+ *   if the op fails.
+ */
+static int replay_checked(const traceop_t *op, char **blocks,
+                          size_t *block_sizes, int tracenum, int opnum,
+                          long *total_size) {
+    opdesc_t *desc = &op_table[op->type];
+    int j, size = op->size;
+    size_t oldsize = 0;
+    char *p, *oldp = NULL;
+
+    /* The block the op consumes must be intact */
+    if (desc->flags & OP_OLD) {
+        oldp = blocks[op->index];
+        oldsize = block_sizes[op->index];
+        if (oldp[0] != STREAM_TAG(op->index) ||
+            oldp[oldsize - 1] != STREAM_TAG(op->index)) {
+            malloc_error(tracenum, opnum,
+                         "Payload was overwritten while allocated");
+            return 0;
+        }
+        *total_size -= oldsize;
+    }
+
+    if (!desc->mm(op, oldp, &blocks[op->index])) {
+        sprintf(msg, "mm_%s failed.", desc->name);
+        malloc_error(tracenum, opnum, msg);
+        return 0;
+    }
+    if (!(desc->flags & OP_NEW))
+        return 1;
+
+    for (j = op->index; j < op->index + NEW_BLOCKS(op); j++) {
+        p = blocks[j];
+        if (!check_payload(p, size, tracenum, opnum))
+            return 0;
+        if (op->type == MEMALIGN && (size_t)p % (size_t)op->align) {
+            sprintf(msg, "mm_%s block misaligned.", desc->name);
+            malloc_error(tracenum, opnum, msg);
+            return 0;
+        }
+        if ((desc->flags & OP_OLD) && p[0] != STREAM_TAG(j)) {
+            sprintf(msg, "mm_%s did not preserve the data from old block",
+                    desc->name);
+            malloc_error(tracenum, opnum, msg);
+            return 0;
+        }
+
+        p[0] = p[size - 1] = STREAM_TAG(j);
+        block_sizes[j] = size;
+        *total_size += size;
+    }
+    return 1;
+}
+
+/*
+ * eval_mm_stream - Replay a trace in windows of stream_window ops (-w),
+ *   for traces too large to load whole. One pass checks correctness (see
+ *   replay_checked) and measures utilization together. A second pass is
+ *   timed for throughput. Returns 1 if the trace ran correctly.
+ */
+static int eval_mm_stream(char *filename, int tracenum, stats_t *stats) {
+    char path[MAXLINE];
+    trace_stream_t *stream;
+    trace_t *trace;
+    traceop_t *ops;
+    int i, n;
+    int opnum = 0;
+    int valid = 0;
+    long total_size = 0;
+    long max_total_size = 0;
+
+    strcpy(path, tracedir);
+    strcat(path, filename);
+    if ((stream = trace_stream_open(path, stream_window, &trace)) == NULL) {
+        /* Long paths are cut short rather than overrunning msg */
+        snprintf(msg, sizeof(msg), "Could not open %.900s in eval_mm_stream",
+                 path);
+        unix_error(msg);
+    }
+    stats->ops = trace->num_ops;
+    stats->weight = trace->weight;
+    size_heap(trace->sugg_heapsize);
+
+    /* Reset the heap and call the mm package's init function */
+    mem_reset_brk();
+    if (mm_init() < 0) {
+        malloc_error(tracenum, 0, "mm_init failed.");
+        goto done;
+    }
+
+    while ((n = trace_stream_next(stream, &ops)) > 0) {
+        for (i = 0; i < n; i++, opnum++) {
+            if (!replay_checked(&ops[i], trace->blocks, trace->block_sizes,
+                                tracenum, opnum, &total_size))
+                goto done;
+            if (total_size > max_total_size)
+                max_total_size = total_size;
+            if (frag_interval && (opnum + 1) % frag_interval == 0)
+                sample_frag(opnum + 1, total_size);
+        }
+    }
+
+    valid = 1;
+    stats->util = (double)max_total_size / (double)mem_peak_heapsize();
+
+ done:
+    trace_stream_close(stream);
+    trace_free(trace);
+
+    if (valid) {
+        if (verbose > 1)
+            printf("Timing mm_malloc on the stream.\n");
+        stats->secs = ftimer_gettod(eval_mm_stream_speed, path, 1);
+    }
+    return valid;
+}
+
+/*
+ * eval_mm_stream_speed - Replay the trace at path (a char *) in windows
+ *    with no checks, as timed by eval_mm_stream.
+ */
+static void eval_mm_stream_speed(void *ptr) {
+    trace_stream_t *stream;
+    trace_t *trace;
+    traceop_t *ops;
+    int i, n;
+
+    if ((stream = trace_stream_open((char *)ptr, stream_window, &trace)) == NULL)
+        unix_error("Could not reopen the trace in eval_mm_stream_speed");
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+        app_error("mm_init failed in eval_mm_stream_speed");
+
+    while ((n = trace_stream_next(stream, &ops)) > 0)
+        for (i = 0; i < n; i++)
+            if (!replay(trace, &ops[i], 0))
+                app_error("mm op failed in eval_mm_stream_speed");
+
+    trace_stream_close(stream);
+    trace_free(trace);
+}
+
+/*
+ * Multi-threaded replay (-T). mm is single-threaded, so, as in libmm,
+ * every mm call holds one global lock; what the threads measure is the
+ * allocator under that lock with its calls arriving from many threads.
+ *
+ * A trace that records threads (trace v2, TRACE_TIDS) is split by tid
+ * over the replay threads, all sharing one block table, so a block made
+ * by one thread may be freed by another. An op waits until the last op
+ * on each block it names has run; ops are in trace order, so the oldest
+ * op yet to run never waits and the replay cannot deadlock. Any other
+ * trace is replayed whole by every thread, on its own block table.
+ */
+
+/* Timed passes of a threaded replay; the fastest one counts */
+#define THREAD_RUNS 3
+
+/* The threads replaying one trace */
+typedef struct {
+    trace_t *trace;
+    int tracenum;
+    int threads;
+    int shared;         /* ops split by tid over one block table */
+    int check;          /* checked pass rather than timed one */
+    int *dep_at;        /* shared: deps of op i at dep_at[i]..dep_at[i+1] */
+    int *deps;          /* shared: op that last named each block, or -1 */
+    char *done;         /* shared: op i has run */
+    int failed;         /* some op failed, so stop */
+    long total_size;    /* payload bytes live, kept in the checked pass */
+    long max_total_size;
+    pthread_barrier_t start;
+} replay_t;
+
+/* One of its threads */
+typedef struct {
+    replay_t *replay;
+    pthread_t thread;
+    int id;
+    int *ops;           /* indexes of this thread's ops in trace->ops */
+    int num_ops;
+    char **blocks;      /* this thread's block table */
+    size_t *block_sizes;
+    double start, end;  /* when it started and finished its ops */
+    double secs;        /* time over its ops, waits for others excluded */
+    double best_secs;   /* secs in the fastest timed pass */
+} replay_thread_t;
+
+static pthread_mutex_t mm_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * wall_secs - Seconds on the monotonic clock
+ */
+static double wall_secs(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + 1E-9 * ts.tv_nsec;
+}
+
+/*
+ * replay_thread - Replay one thread's ops, waiting out those of other
+ *   threads that they depend on
+ */
+static void *replay_thread(void *arg) {
+    replay_thread_t *t = (replay_thread_t *)arg;
+    replay_t *r = t->replay;
+    traceop_t *op;
+    double wait = 0, waited;
+    int i, k, d, ok;
+
+    pthread_barrier_wait(&r->start);
+    t->start = wall_secs();
+
+    for (k = 0; k < t->num_ops && !__atomic_load_n(&r->failed, __ATOMIC_RELAXED); k++) {
+        i = t->ops[k];
+        op = &r->trace->ops[i];
+
+        if (r->shared) {
+            waited = 0;
+            for (d = r->dep_at[i]; d < r->dep_at[i + 1]; d++)
+                while (r->deps[d] >= 0 &&
+                       !__atomic_load_n(&r->done[r->deps[d]], __ATOMIC_ACQUIRE)) {
+                    if (!waited)
+                        waited = wall_secs();
+                    if (__atomic_load_n(&r->failed, __ATOMIC_RELAXED))
+                        goto out;
+                    sched_yield();
+                }
+            if (waited)
+                wait += wall_secs() - waited;
+        }
+
+        pthread_mutex_lock(&mm_lock);
+        if (r->check) {
+            ok = replay_checked(op, t->blocks, t->block_sizes, r->tracenum,
+                                i, &r->total_size);
+            if (r->total_size > r->max_total_size)
+                r->max_total_size = r->total_size;
+        } else {
+            opdesc_t *desc = &op_table[op->type];
+            char *old = (desc->flags & OP_OLD) ? t->blocks[op->index] : NULL;
+
+            ok = desc->mm(op, old, &t->blocks[op->index]);
+        }
+        pthread_mutex_unlock(&mm_lock);
+
+        if (!ok) {
+            __atomic_store_n(&r->failed, 1, __ATOMIC_RELAXED);
+            break;
         }
+        if (r->shared)
+            __atomic_store_n(&r->done[i], 1, __ATOMIC_RELEASE);
+    }
+
+ out:
+    t->end = wall_secs();
+    t->secs = t->end - t->start - wait;
+    return NULL;
+}
+
+/*
+ * run_replay - Run one pass of r over threads t from a fresh heap.
+ *   Returns the wall time of the pass, from the first thread starting
+ *   its ops to the last finishing them, or -1 if an op failed.
+ */
+static double run_replay(replay_t *r, replay_thread_t *t) {
+    double start, end;
+    int i;
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+        app_error("mm_init failed in run_replay");
+    r->failed = 0;
+    r->total_size = r->max_total_size = 0;
+    if (r->shared)
+        memset(r->done, 0, r->trace->num_ops);
+
+    pthread_barrier_init(&r->start, NULL, r->threads + 1);
+    for (i = 0; i < r->threads; i++)
+        if (pthread_create(&t[i].thread, NULL, replay_thread, &t[i]) != 0)
+            unix_error("pthread_create failed in run_replay");
+    pthread_barrier_wait(&r->start);
+    for (i = 0; i < r->threads; i++)
+        pthread_join(t[i].thread, NULL);
+    pthread_barrier_destroy(&r->start);
+
+    start = t[0].start;
+    end = t[0].end;
+    for (i = 1; i < r->threads; i++) {
+        start = (t[i].start < start) ? t[i].start : start;
+        end = (t[i].end > end) ? t[i].end : end;
+    }
+    return r->failed ? -1 : end - start;
+}
+
+/*
+ * eval_mm_threads - Check, measure and time trace on threads threads,
+ *   sharing its ops out if shared and otherwise giving each thread a
+ *   copy. The time in stats is that of the fastest of THREAD_RUNS timed
+ *   passes; it and the ops cover all the threads together. If report,
+ *   print each thread's time per op in that pass, less the time it spent
+ *   waiting on other threads' ops. Returns 1 if the trace ran correctly.
+ */
+static int eval_mm_threads(trace_t *trace, int tracenum, int threads,
+                           int shared, int report, stats_t *stats) {
+    replay_t r;
+    replay_thread_t *t;
+    int *last, *all = NULL;
+    int i, j, k, n, ids, valid;
+    double secs;
+
+    memset(&r, 0, sizeof(r));
+    r.trace = trace;
+    r.tracenum = tracenum;
+    r.threads = threads;
+    r.shared = shared;
+
+    if ((t = (replay_thread_t *)calloc(threads,
+                                       sizeof(replay_thread_t))) == NULL)
+        unix_error("calloc failed in eval_mm_threads");
+
+    if (r.shared) {
+        /* Each op depends on the last op naming each of its blocks */
+        for (i = n = 0; i < trace->num_ops; i++)
+            n += NEW_BLOCKS(&trace->ops[i]);
+        r.dep_at = (int *)malloc((trace->num_ops + 1) * sizeof(int));
+        r.deps = (int *)malloc(n * sizeof(int));
+        r.done = (char *)malloc(trace->num_ops);
+        last = (int *)malloc(trace->num_ids * sizeof(int));
+        if (!r.dep_at || !r.deps || !r.done || !last)
+            unix_error("malloc failed in eval_mm_threads");
+        for (i = 0; i < trace->num_ids; i++)
+            last[i] = -1;
+        for (i = n = 0; i < trace->num_ops; i++) {
+            r.dep_at[i] = n;
+            for (j = trace->ops[i].index;
+                 j < trace->ops[i].index + NEW_BLOCKS(&trace->ops[i]); j++) {
+                r.deps[n++] = last[j];
+                last[j] = i;
+            }
+        }
+        r.dep_at[i] = n;
+        free(last);
+
+        /* Thread tid % threads replays the ops of tid or, if the trace
+         * does not record threads, deal the ops out in turn */
+        for (i = 0; i < threads; i++)
+            if ((t[i].ops = (int *)malloc(trace->num_ops * sizeof(int))) == NULL)
+                unix_error("malloc failed in eval_mm_threads");
+        for (i = 0; i < trace->num_ops; i++) {
+            k = (trace->flags & TRACE_TIDS) ? trace->ops[i].tid % threads
+                                            : i % threads;
+            t[k].ops[t[k].num_ops++] = i;
+        }
+        for (i = 0; i < threads; i++) {
+            t[i].blocks = trace->blocks;
+            t[i].block_sizes = trace->block_sizes;
+        }
+        stats->ops = trace->num_ops;
+    } else {
+        /* Every thread replays the whole trace on its own blocks */
+        if ((all = (int *)malloc(trace->num_ops * sizeof(int))) == NULL)
+            unix_error("malloc failed in eval_mm_threads");
+        for (i = 0; i < trace->num_ops; i++)
+            all[i] = i;
+        ids = trace->num_ids ? trace->num_ids : 1;
+        for (i = 0; i < threads; i++) {
+            t[i].ops = all;
+            t[i].num_ops = trace->num_ops;
+            t[i].blocks = (char **)calloc(ids, sizeof(char *));
+            t[i].block_sizes = (size_t *)calloc(ids, sizeof(size_t));
+            if (!t[i].blocks || !t[i].block_sizes)
+                unix_error("calloc failed in eval_mm_threads");
+        }
+        stats->ops = (double)trace->num_ops * threads;
+    }
+    for (i = 0; i < threads; i++) {
+        t[i].replay = &r;
+        t[i].id = i;
+    }
+
+    /* A checked pass for correctness and utilization, then a timed one */
+    r.check = 1;
+    valid = run_replay(&r, t) >= 0;
+    if (valid) {
+        stats->util = (double)r.max_total_size / (double)mem_peak_heapsize();
+        r.check = 0;
+        stats->secs = DBL_MAX;
+        for (k = 0; k < THREAD_RUNS; k++) {
+            if ((secs = run_replay(&r, t)) < 0)
+                app_error("mm op failed in the timed threaded replay");
+            if (secs < stats->secs) {
+                stats->secs = secs;
+                for (i = 0; i < threads; i++)
+                    t[i].best_secs = t[i].secs;
+            }
+        }
+
+        if (report) {
+            printf("trace %d per thread (waits for other threads' ops "
+                   "excluded):\n", tracenum);
+            printf("%8s%10s%10s%10s\n", "thread", "ops", "secs", "ns/op");
+            for (i = 0; i < threads; i++)
+                printf("%8d%10d%10.6f%10.0f\n", i, t[i].num_ops,
+                       t[i].best_secs, t[i].num_ops ?
+                       1E9 * t[i].best_secs / t[i].num_ops : 0.0);
+        }
+    }
+
+    for (i = 0; i < threads; i++) {
+        if (r.shared) {
+            free(t[i].ops);
+        } else {
+            free(t[i].blocks);
+            free(t[i].block_sizes);
+        }
+    }
+    free(all);
+    free(r.dep_at);
+    free(r.deps);
+    free(r.done);
+    free(t);
+    return valid;
+}
+
+/*
+ * eval_mm_scaling - Replay the traces on 1, 2, 4, ... threads, up to
+ *   scaling_threads, once with a copy of each trace per thread and once
+ *   with the ops of each trace shared out over one block table, and
+ *   print the total throughput of each, its speedup over one thread and
+ *   its parallel efficiency (speedup / threads). The copies keep the
+ *   work per thread constant and the shared traces the total work.
+ *
+ *   mm has no per-thread state: every call holds mm_lock, so the curve
+ *   shows how the calls queue on that lock and hand it between threads,
+ *   not how an allocator with per-thread heaps or arenas would scale.
+ *   More threads also interleave the calls differently, and so build a
+ *   different heap: on a fragmenting trace such as binary-bal that can
+ *   make each call cheaper, and the speedup exceed the CPUs there were.
+ *   The header says both, along with the CPUs online.
+ */
+static void eval_mm_scaling(char **tracefiles, int num_tracefiles) {
+    static char *modes[] = {"independent traces", "shared heap"};
+    trace_t **traces;
+    stats_t stats;
+    double ops, secs, kops, base[2] = {0, 0};
+    long cpus;
+    int i, mode, threads, valid;
+
+    if ((traces = (trace_t **)malloc(num_tracefiles * sizeof(trace_t *))) == NULL)
+        unix_error("malloc failed in eval_mm_scaling");
+    for (i = 0; i < num_tracefiles; i++)
+        traces[i] = read_trace(tracedir, tracefiles[i]);
+
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    printf("\nmm throughput on 1 to %d threads, %ld CPU%s online:\n",
+           scaling_threads, cpus, cpus == 1 ? "" : "s");
+    printf("(every mm call holds one global lock, so this measures handing "
+           "that lock\n between threads, not allocator scaling; the calls "
+           "interleave differently\n on each thread count, which changes "
+           "the heap they build and so what each\n call costs)\n");
+    printf("%8s%30s%30s\n", "", modes[0], modes[1]);
+    printf("%8s", "threads");
+    for (mode = 0; mode < 2; mode++)
+        printf("%12s%9s%9s", "Kops", "speedup", "effcy");
+    printf("\n");
+
+    for (threads = 1; ; threads *= 2) {
+        if (threads > scaling_threads)
+            threads = scaling_threads;
+        printf("%8d", threads);
+        for (mode = 0; mode < 2; mode++) {
+            ops = secs = 0;
+            valid = 1;
+            for (i = 0; i < num_tracefiles && valid; i++) {
+                memset(&stats, 0, sizeof(stats));
+                valid = eval_mm_threads(traces[i], i, threads, mode, 0,
+                                        &stats);
+                ops += stats.ops;
+                secs += stats.secs;
+            }
+            if (!valid) {
+                printf("%12s%9s%9s", "-", "-", "-");
+                continue;
+            }
+            kops = ops / secs / 1e3;
+            if (threads == 1)
+                base[mode] = kops;
+            printf("%12.0f%9.2f%8.0f%%", kops, kops / base[mode],
+                   100.0 * kops / base[mode] / threads);
+        }
+        printf("\n");
+        fflush(stdout);
+        if (threads == scaling_threads)
+            break;
+    }
+
+    for (i = 0; i < num_tracefiles; i++)
+        free_trace(traces[i]);
+    free(traces);
+}
+
+/*
+ * Producer/consumer replay (-P). Producer threads allocate objects with
+ * the sizes of the blocks a trace makes, in trace order, and pass them
+ * through single-producer single-consumer lock-free queues, one for each
+ * producer and consumer pair, to consumer threads that free them. As with
+ * -T, every mm call holds mm_lock. Each run is compared with a local one,
+ * in which a single thread frees each object itself once PC_QUEUE_SIZE
+ * newer ones are queued behind it, and the difference in the cost of a
+ * free is reported as what freeing on another thread adds.
+ *
+ * mm has no notion of which thread owns a block: a free on another
+ * thread takes the same path, under the same lock, as a local one. So
+ * the remote cost is only lock contention and cache misses on blocks
+ * written by another CPU, and is expected to stay near zero.
+ */
+
+/* Objects a queue holds; a producer waits while its queue is full */
+#define PC_QUEUE_SIZE 256
+
+/* An object in flight */
+typedef struct {
+    char *ptr;
+    int size;
+} pc_obj_t;
+
+/* A queue from one producer to one consumer; each index is written by
+ * one side only, so the two live on separate cache lines */
+typedef struct {
+    pc_obj_t slot[PC_QUEUE_SIZE];
+    unsigned head __attribute__((aligned(64))); /* next to pop */
+    unsigned tail __attribute__((aligned(64))); /* next to push */
+} pc_queue_t;
+
+/* One producer/consumer run */
+typedef struct {
+    int *sizes;         /* object sizes each producer allocates in turn */
+    int num_sizes;
+    int tracenum;
+    int producers;
+    int consumers;      /* 0 for the local run */
+    pc_queue_t *queues; /* producer i to consumer j at i * consumers + j */
+    int producing;      /* producers yet to finish */
+    int failed;         /* some check failed, so stop */
+    long live;          /* payload bytes allocated and not freed (mm_lock) */
+    long peak_live;
+    pthread_barrier_t start;
+} pc_t;
+
+/* One of its threads */
+typedef struct {
+    pc_t *pc;
+    pthread_t thread;
+    int id;
+    long mallocs;       /* mm calls made, and the time they took */
+    long frees;
+    double malloc_secs;
+    double free_secs;
+    double start, end;  /* when it started and finished its share */
+} pc_thread_t;
+
+/* What a run measured */
+typedef struct {
+    double objects;     /* objects allocated and freed */
+    double secs;        /* wall time of the run */
+    double malloc_secs; /* time spent in mm_malloc, over all threads */
+    double free_secs;   /* time spent in mm_free, over all threads */
+    size_t peak_heap;   /* heap high water mark */
+    long peak_live;     /* most payload bytes live at once */
+} pc_result_t;
+
+static int pc_push(pc_queue_t *q, const pc_obj_t *obj) {
+    unsigned tail = q->tail;
+
+    if (tail - __atomic_load_n(&q->head, __ATOMIC_ACQUIRE) == PC_QUEUE_SIZE)
+        return 0;
+    q->slot[tail % PC_QUEUE_SIZE] = *obj;
+    __atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+static int pc_pop(pc_queue_t *q, pc_obj_t *obj) {
+    unsigned head = q->head;
+
+    if (__atomic_load_n(&q->tail, __ATOMIC_ACQUIRE) == head)
+        return 0;
+    *obj = q->slot[head % PC_QUEUE_SIZE];
+    __atomic_store_n(&q->head, head + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+/*
+ * pc_malloc - Allocate and tag object number objnum for t. Returns 0
+ *   (and reports an error) if mm fails.
+ */
+static int pc_malloc(pc_thread_t *t, pc_obj_t *obj, int objnum) {
+    pc_t *pc = t->pc;
+    double start = wall_secs();
+    int ok;
+
+    pthread_mutex_lock(&mm_lock);
+    obj->ptr = mm_malloc(obj->size);
+    t->malloc_secs += wall_secs() - start;
+    if ((ok = obj->ptr != NULL &&
+         check_payload(obj->ptr, obj->size, pc->tracenum, objnum))) {
+        if ((pc->live += obj->size) > pc->peak_live)
+            pc->peak_live = pc->live;
+    } else if (obj->ptr == NULL) {
+        malloc_error(pc->tracenum, objnum, "mm_malloc failed.");
+    }
+    pthread_mutex_unlock(&mm_lock);
+
+    t->mallocs++;
+    if (ok)
+        obj->ptr[0] = obj->ptr[obj->size - 1] = STREAM_TAG(obj->size);
+    return ok;
+}
+
+/*
+ * pc_free - Check the tags of obj and free it for t. Returns 0 (and
+ *   reports an error) if they were overwritten.
+ */
+static int pc_free(pc_thread_t *t, pc_obj_t *obj) {
+    pc_t *pc = t->pc;
+    double start;
+
+    if (obj->ptr[0] != STREAM_TAG(obj->size) ||
+        obj->ptr[obj->size - 1] != STREAM_TAG(obj->size)) {
+        pthread_mutex_lock(&mm_lock);
+        malloc_error(pc->tracenum, 0, "Payload was overwritten in a queue");
+        pthread_mutex_unlock(&mm_lock);
+        return 0;
+    }
+
+    start = wall_secs();
+    pthread_mutex_lock(&mm_lock);
+    mm_free(obj->ptr);
+    t->free_secs += wall_secs() - start;
+    pc->live -= obj->size;
+    pthread_mutex_unlock(&mm_lock);
+
+    t->frees++;
+    return 1;
+}
+
+/*
+ * pc_producer - Allocate the objects and deal them out over this
+ *   producer's queues, or in the local run free them itself
+ */
+static void *pc_producer(void *arg) {
+    pc_thread_t *t = (pc_thread_t *)arg;
+    pc_t *pc = t->pc;
+    pc_queue_t *q;
+    pc_obj_t obj, old;
+    int k;
+
+    pthread_barrier_wait(&pc->start);
+    t->start = wall_secs();
+
+    for (k = 0; k < pc->num_sizes; k++) {
+        if (__atomic_load_n(&pc->failed, __ATOMIC_RELAXED))
+            break;
+        obj.size = pc->sizes[k];
+        if (!pc_malloc(t, &obj, k))
+            goto fail;
+
+        if (pc->consumers == 0) {
+            q = &pc->queues[0];
+            if (!pc_push(q, &obj)) {
+                pc_pop(q, &old);
+                if (!pc_free(t, &old))
+                    goto fail;
+                pc_push(q, &obj);
+            }
+            continue;
+        }
+
+        q = &pc->queues[t->id * pc->consumers + k % pc->consumers];
+        while (!pc_push(q, &obj)) {
+            if (__atomic_load_n(&pc->failed, __ATOMIC_RELAXED))
+                goto out;
+            sched_yield();
+        }
+    }
+
+    /* The local run drains its own queue */
+    if (pc->consumers == 0)
+        while (pc_pop(&pc->queues[0], &old))
+            if (!pc_free(t, &old))
+                goto fail;
+    goto out;
+
+ fail:
+    __atomic_store_n(&pc->failed, 1, __ATOMIC_RELAXED);
+ out:
+    __atomic_sub_fetch(&pc->producing, 1, __ATOMIC_RELEASE);
+    t->end = wall_secs();
+    return NULL;
+}
+
+/*
+ * pc_consumer - Free whatever arrives on this consumer's queues until the
+ *   producers are done and the queues are empty
+ */
+static void *pc_consumer(void *arg) {
+    pc_thread_t *t = (pc_thread_t *)arg;
+    pc_t *pc = t->pc;
+    pc_obj_t obj;
+    int i, busy, done;
+
+    pthread_barrier_wait(&pc->start);
+    t->start = wall_secs();
+
+    for (;;) {
+        /* Anything pushed before the last producer finished shows up in
+         * the sweep that follows */
+        done = __atomic_load_n(&pc->producing, __ATOMIC_ACQUIRE) == 0;
+        busy = 0;
+        for (i = 0; i < pc->producers; i++) {
+            while (pc_pop(&pc->queues[i * pc->consumers + t->id], &obj)) {
+                if (!pc_free(t, &obj)) {
+                    __atomic_store_n(&pc->failed, 1, __ATOMIC_RELAXED);
+                    goto out;
+                }
+                busy = 1;
+            }
+        }
+        if (!busy) {
+            if (done || __atomic_load_n(&pc->failed, __ATOMIC_RELAXED))
+                goto out;
+            sched_yield();
+        }
+    }
+
+ out:
+    t->end = wall_secs();
+    return NULL;
+}
+
+/*
+ * run_pc - Run producers against consumers (0 for the local run) on the
+ *   object sizes of trace tracenum from a fresh heap, into *res, timed
+ *   from the first thread starting to the last finishing. Returns 1 if
+ *   every object made it through intact.
+ */
+static int run_pc(int *sizes, int num_sizes, int tracenum, int producers,
+                  int consumers, pc_result_t *res) {
+    pc_t pc;
+    pc_thread_t *t;
+    int i, n = producers + consumers;
+    double start, end;
+
+    memset(&pc, 0, sizeof(pc));
+    pc.sizes = sizes;
+    pc.num_sizes = num_sizes;
+    pc.tracenum = tracenum;
+    pc.producers = producers;
+    pc.consumers = consumers;
+    pc.producing = producers;
+    pc.queues = (pc_queue_t *)aligned_alloc(64, sizeof(pc_queue_t) *
+                                            (consumers ? producers * consumers : 1));
+    t = (pc_thread_t *)calloc(n, sizeof(pc_thread_t));
+    if (pc.queues == NULL || t == NULL)
+        unix_error("malloc failed in run_pc");
+    memset(pc.queues, 0, sizeof(pc_queue_t) *
+           (consumers ? producers * consumers : 1));
+
+    mem_reset_brk();
+    if (mm_init() < 0)
+        app_error("mm_init failed in run_pc");
+
+    pthread_barrier_init(&pc.start, NULL, n + 1);
+    for (i = 0; i < n; i++) {
+        t[i].pc = &pc;
+        t[i].id = i < producers ? i : i - producers;
+        if (pthread_create(&t[i].thread, NULL,
+                           i < producers ? pc_producer : pc_consumer,
+                           &t[i]) != 0)
+            unix_error("pthread_create failed in run_pc");
+    }
+    pthread_barrier_wait(&pc.start);
+    for (i = 0; i < n; i++)
+        pthread_join(t[i].thread, NULL);
+    pthread_barrier_destroy(&pc.start);
+
+    start = t[0].start;
+    end = t[0].end;
+    for (i = 1; i < n; i++) {
+        start = (t[i].start < start) ? t[i].start : start;
+        end = (t[i].end > end) ? t[i].end : end;
+    }
+    res->secs = end - start;
+
+    res->objects = (double)num_sizes * producers;
+    res->malloc_secs = res->free_secs = 0;
+    for (i = 0; i < n; i++) {
+        res->malloc_secs += t[i].malloc_secs;
+        res->free_secs += t[i].free_secs;
+    }
+    res->peak_heap = mem_peak_heapsize();
+    res->peak_live = pc.peak_live;
+
+    free(pc.queues);
+    free(t);
+    return !pc.failed;
+}
+
+/*
+ * eval_mm_pc - Run the traces through each producer:consumer ratio in
+ *   pc_ratios and print, per ratio, the objects passed per second, the
+ *   cost of a malloc and of a free, what a free costs over the local run
+ *   (remote), the largest heap and the blowup: the heap over the most
+ *   payload live at once, averaged over the traces.
+ */
+static void eval_mm_pc(char **tracefiles, int num_tracefiles) {
+    trace_t *trace;
+    pc_result_t res, sum;
+    int **sizes;
+    int *num_sizes;
+    int i, j, k, r, valid;
+    size_t peak_heap;
+    double blowup, free_ns, local_free = 0;
+    int have_local = 0;
+    char ratio[32];
+
+    sizes = (int **)malloc(num_tracefiles * sizeof(int *));
+    num_sizes = (int *)malloc(num_tracefiles * sizeof(int));
+    if (sizes == NULL || num_sizes == NULL)
+        unix_error("malloc failed in eval_mm_pc");
+
+    /* The sizes of the blocks each trace makes, in order */
+    for (i = 0; i < num_tracefiles; i++) {
+        trace = read_trace(tracedir, tracefiles[i]);
+        for (j = num_sizes[i] = 0; j < trace->num_ops; j++)
+            if (op_table[trace->ops[j].type].flags & OP_NEW)
+                num_sizes[i] += NEW_BLOCKS(&trace->ops[j]);
+        if ((sizes[i] = (int *)malloc(num_sizes[i] * sizeof(int) + 1)) == NULL)
+            unix_error("malloc failed in eval_mm_pc");
+        for (j = num_sizes[i] = 0; j < trace->num_ops; j++)
+            if (op_table[trace->ops[j].type].flags & OP_NEW)
+                for (k = 0; k < NEW_BLOCKS(&trace->ops[j]); k++)
+                    sizes[i][num_sizes[i]++] = trace->ops[j].size;
+        free_trace(trace);
+    }
+
+    printf("\nmm producer/consumer replay (ns per mm call, lock included):\n");
+    printf("(remote is free over the local row; mm does not track which "
+           "thread owns a\n block, so it is only lock contention and cache "
+           "misses and stays near 0)\n");
+    printf("%8s%10s%8s%8s%8s%10s%8s\n", "ratio", "Kobj/s", "malloc", "free",
+           "remote", "heap KB", "blowup");
+
+    /* Row -1 is the local run */
+    for (r = -1; r < num_pc_ratios; r++) {
+        memset(&sum, 0, sizeof(sum));
+        peak_heap = 0;
+        blowup = 0;
+        valid = 1;
+        for (i = 0; i < num_tracefiles && valid; i++) {
+            valid = (r < 0) ? run_pc(sizes[i], num_sizes[i], i, 1, 0, &res)
+                : run_pc(sizes[i], num_sizes[i], i, pc_ratios[r].producers,
+                         pc_ratios[r].consumers, &res);
+            sum.objects += res.objects;
+            sum.secs += res.secs;
+            sum.malloc_secs += res.malloc_secs;
+            sum.free_secs += res.free_secs;
+            if (res.peak_heap > peak_heap)
+                peak_heap = res.peak_heap;
+            if (res.peak_live)
+                blowup += (double)res.peak_heap / res.peak_live;
+        }
+
+        if (r < 0)
+            strcpy(ratio, "local");
+        else
+            sprintf(ratio, "%d:%d", pc_ratios[r].producers,
+                    pc_ratios[r].consumers);
+        if (!valid) {
+            printf("%8s%10s%8s%8s%8s%10s%8s\n", ratio, "-", "-", "-", "-",
+                   "-", "-");
+            continue;
+        }
+
+        free_ns = 1E9 * sum.free_secs / sum.objects;
+        if (r < 0) {
+            local_free = free_ns;
+            have_local = 1;
+        }
+        printf("%8s%10.0f%8.0f%8.0f", ratio, sum.objects / sum.secs / 1E3,
+               1E9 * sum.malloc_secs / sum.objects, free_ns);
+        if (have_local)
+            printf("%8.0f", free_ns - local_free);
+        else
+            printf("%8s", "-");
+        printf("%10lu%8.2f\n", (unsigned long)(peak_heap / 1024),
+               blowup / num_tracefiles);
+        fflush(stdout);
+    }
+
+    for (i = 0; i < num_tracefiles; i++)
+        free(sizes[i]);
+    free(sizes);
+    free(num_sizes);
 }
 
 /*
@@ -709,23 +2143,12 @@ static void eval_mm_speed(void *ptr) {
  */
 static int eval_libc_valid(trace_t *trace, int tracenum) {
     int i;
-    char *p;
 
     for (i = 0;  i < trace->num_ops;  i++) {
-        switch (trace->ops[i].type) {
-        case ALLOC: /* malloc */
-            if ((p = malloc(trace->ops[i].size)) == NULL) {
-                malloc_error(tracenum, i, "libc malloc failed");
-                unix_error("System message");
-            }
-            trace->blocks[trace->ops[i].index] = p;
-            break;
-
-        case FREE: /* free */
-           free(trace->blocks[trace->ops[i].index]);
-           break;
-                default:
-            app_error("invalid operation type  in eval_libc_valid");
+        if (!replay(trace, &trace->ops[i], 1)) {
+            sprintf(msg, "libc %s failed", op_table[trace->ops[i].type].name);
+            malloc_error(tracenum, i, msg);
+            unix_error("System message");
         }
     }
 
@@ -739,27 +2162,11 @@ static int eval_libc_valid(trace_t *trace, int tracenum) {
  */
 static void eval_libc_speed(void *ptr) {
     int i;
-    int index, size;
-    char *p, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
 
-    for (i = 0;  i < trace->num_ops;  i++) {
-        switch (trace->ops[i].type) {
-        case ALLOC: /* malloc */
-            index = trace->ops[i].index;
-            size = trace->ops[i].size;
-            if ((p = malloc(size)) == NULL)
-                unix_error("malloc failed in eval_libc_speed");
-            trace->blocks[index] = p;
-            break;
-
-        case FREE: /* free */
-            index = trace->ops[i].index;
-            block = trace->blocks[index];
-            free(block);
-            break;
-        }
-    }
+    for (i = 0;  i < trace->num_ops;  i++)
+        if (!replay(trace, &trace->ops[i], 1))
+            unix_error("libc op failed in eval_libc_speed");
 }
 
 /*************************************
@@ -820,6 +2227,98 @@ static void printresults(int n, stats_t *stats) {
     }
 }
 
+/*
+ * set_mm_knob - apply a "name=value" -o argument through mm_ctl
+ */
+static void set_mm_knob(char *arg) {
+    char *eq = strchr(arg, '=');
+    size_t value;
+
+    if (eq == NULL) {
+        usage();
+        exit(1);
+    }
+    *eq = '\0';
+    value = strtoul(eq + 1, NULL, 0);
+    if (mm_ctl(arg, NULL, &value) < 0) {
+        sprintf(msg, "Could not set mm knob %s to %s", arg, eq + 1);
+        app_error(msg);
+    }
+}
+
+/*
+ * set_pc_ratios - parse a "p:c[,p:c...]" -P argument into pc_ratios
+ */
+static void set_pc_ratios(char *arg) {
+    char *ratio;
+    int p, c;
+
+    for (ratio = strtok(arg, ","); ratio; ratio = strtok(NULL, ",")) {
+        if (sscanf(ratio, "%d:%d", &p, &c) != 2 || p <= 0 || c <= 0 ||
+            num_pc_ratios == PC_MAX_RATIOS) {
+            usage();
+            exit(1);
+        }
+        pc_ratios[num_pc_ratios].producers = p;
+        pc_ratios[num_pc_ratios].consumers = c;
+        num_pc_ratios++;
+    }
+}
+
+/*
+ * print_mm_stats - prints the heap counters kept by the mm package
+ */
+static void print_mm_stats(void) {
+    int i;
+    mm_stats_t st;
+
+    mm_get_stats(&st);
+    printf("heap: %lu bytes (peak %lu) in %lu sbrk calls\n",
+           (unsigned long)st.heap_size, (unsigned long)st.peak_heap_size,
+           (unsigned long)st.sbrk_calls);
+    printf("in use: %lu bytes, free: %lu bytes, cached: %lu bytes, "
+           "fresh: %lu bytes\n",
+           (unsigned long)st.bytes_in_use, (unsigned long)st.bytes_free,
+           (unsigned long)st.bytes_cached, (unsigned long)st.bytes_fresh);
+    printf("splits: %lu, coalesces: %lu, policy switches: %lu\n",
+           (unsigned long)st.splits, (unsigned long)st.coalesces,
+           (unsigned long)st.policy_switches);
+    printf("free blocks by size class:");
+    for (i = 0; i < MM_NUM_SIZE_CLASSES; i++)
+        printf(" %lu", (unsigned long)st.free_blocks[i]);
+    printf("\n");
+}
+
+#ifdef MM_INSTRUMENT
+/*
+ * print_mm_instr - dumps the hot-path histograms that the instrumented
+ *     mm package collected while eval_mm_util replayed trace tracenum
+ */
+static void print_mm_instr(int tracenum) {
+    int i;
+    char label[MAXLINE];
+    mm_instr_t in;
+
+    mm_get_instr(&in);
+    printf("\ntrace %d search length histogram:\n", tracenum);
+    for (i = 0; i < MM_HIST_BUCKETS; i++) {
+        if (in.search_len[i] == 0)
+            continue;
+        if (i == 0)
+            sprintf(label, "0");
+        else
+            sprintf(label, "%lu-%lu", 1UL << (i - 1), (1UL << i) - 1);
+        printf("%16s %10lu\n", label, (unsigned long)in.search_len[i]);
+    }
+    printf("trace %d splits: %lu of %lu mallocs\n", tracenum,
+           (unsigned long)in.split[1],
+           (unsigned long)(in.split[0] + in.split[1]));
+    printf("trace %d merges per coalesce: 0=%lu 1=%lu 2=%lu\n", tracenum,
+           (unsigned long)in.merges[0], (unsigned long)in.merges[1],
+           (unsigned long)in.merges[2]);
+}
+#endif
+
 /*
  * app_error - Report an arbitrary application error
  */
@@ -848,14 +2347,22 @@ void malloc_error(int tracenum, int opnum, char *msg) {
  * usage - Explain the command line arguments
  */
 static void usage(void) {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvValp] [-f <file>] [-t <dir>] [-s <n>] [-w <n>] [-T <n>] [-S <n>] [-P <p>:<c>] [-o <knob>=<n>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-o <k>=<n> Set mm knob <k> (see mm_ctl) to <n>.\n");
+    fprintf(stderr, "\t-p         Print op latency percentiles by op type and size.\n");
+    fprintf(stderr, "\t-P <p>:<c> Pass objects from <p> producer to <c> consumer threads\n"
+            "\t           (a comma-separated list runs each ratio).\n");
+    fprintf(stderr, "\t-s <n>     Sample fragmentation every <n> ops.\n");
+    fprintf(stderr, "\t-S <n>     Print throughput on 1, 2, 4, ... <n> threads.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+    fprintf(stderr, "\t-T <n>     Replay traces on <n> threads.\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
+    fprintf(stderr, "\t-w <n>     Stream traces in windows of <n> ops instead of loading them.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
 }
 
@@ -14,30 +14,69 @@
 #include "memlib.h"
 #include "config.h"
 
+/*
+ * Built with -DMEMLIB_MMAP (as for libmm.so), the heap is a large
+ * reservation of anonymous memory instead of a malloc'd MAX_HEAP buffer,
+ * so memlib neither calls malloc itself nor caps a real process at the
+ * driver's heap size. Pages are only committed as the heap touches them,
+ * and mem_trim hands trimmed pages back to the kernel.
+ */
+#ifdef MEMLIB_MMAP
+#define HEAP_RESERVE ((size_t)1 << 36)
+#else
+#define HEAP_RESERVE MAX_HEAP
+#endif
+
 /* private variables */
 static char *mem_start_brk;  /* points to first byte of heap */
 static char *mem_brk;        /* points to last byte of heap */
 static char *mem_max_addr;   /* largest legal heap address */
+static char *mem_peak_brk;   /* highest value mem_brk has reached */
 
 /* 
  * mem_init - initialize the memory system model
  */
 void mem_init(void) {
+  mem_init_heap(HEAP_RESERVE);
+}
+
+/*
+ * mem_init_heap - initialize the memory system model with room for a
+ *    heap of max_heap bytes rather than MAX_HEAP (ignored with MEMLIB_MMAP)
+ */
+void mem_init_heap(size_t max_heap) {
   /* allocate the storage we will use to model the available VM */
-  if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
+#ifdef MEMLIB_MMAP
+  max_heap = HEAP_RESERVE;
+  mem_start_brk = (char *)mmap(NULL, HEAP_RESERVE, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                               -1, 0);
+  if (mem_start_brk == (char *)MAP_FAILED) {
+    static const char msg[] = "mem_init_vm: mmap error\n";
+    write(STDERR_FILENO, msg, sizeof(msg) - 1);
+    _exit(1);
+  }
+#else
+  if ((mem_start_brk = (char *)malloc(max_heap)) == NULL) {
     fprintf(stderr, "mem_init_vm: malloc error\n");
     exit(1);
   }
+#endif
 
-  mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
+  mem_max_addr = mem_start_brk + max_heap;  /* max legal heap address */
   mem_brk = mem_start_brk;                  /* heap is empty initially */
+  mem_peak_brk = mem_start_brk;
 }
 
 /* 
  * mem_deinit - free the storage used by the memory system model
  */
 void mem_deinit(void) {
+#ifdef MEMLIB_MMAP
+  munmap(mem_start_brk, mem_max_addr - mem_start_brk);
+#else
   free(mem_start_brk);
+#endif
 }
 
 /*
@@ -45,25 +84,53 @@ void mem_deinit(void) {
  */
 void mem_reset_brk() {
   mem_brk = mem_start_brk;
+  mem_peak_brk = mem_start_brk;
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    by incr bytes and returns the start address of the new area. Use
+ *    mem_trim to shrink the heap.
  */
 void *mem_sbrk(size_t incr) {
   char *old_brk = mem_brk;
 
   if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr) ) {
     errno = ENOMEM;
+#ifndef MEMLIB_MMAP
     fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
+#endif
     return (void *)-1;
   }
   mem_brk += incr;
+  if (mem_brk > mem_peak_brk)
+    mem_peak_brk = mem_brk;
   return (void *)old_brk;
 }
 
+/*
+ * mem_trim - gives the last decr bytes of the heap back. Returns 0 on
+ *    success and -1 if the heap is smaller than decr.
+ */
+int mem_trim(size_t decr) {
+  if (decr > (size_t)(mem_brk - mem_start_brk)) {
+    errno = EINVAL;
+    return -1;
+  }
+  mem_brk -= decr;
+#ifdef MEMLIB_MMAP
+  {
+    /* Release the whole pages above the new brk */
+    size_t page = mem_pagesize();
+    char *start = (char *)(((size_t)mem_brk + page - 1) & ~(page - 1));
+    if (start < mem_brk + decr)
+      madvise(start, (size_t)(mem_brk + decr - start) & ~(page - 1),
+              MADV_DONTNEED);
+  }
+#endif
+  return 0;
+}
+
 /*
  * mem_heap_lo - return address of the first heap byte
  */
@@ -85,6 +152,14 @@ size_t mem_heapsize() {
   return (size_t)(mem_brk - mem_start_brk);
 }
 
+/*
+ * mem_peak_heapsize() - returns the largest heap size in bytes since
+ *    the last mem_init or mem_reset_brk
+ */
+size_t mem_peak_heapsize() {
+  return (size_t)(mem_peak_brk - mem_start_brk);
+}
+
 /*
  * mem_pagesize() - returns the page size of the system
  */
@@ -1,11 +1,21 @@
 #include <unistd.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 void mem_init(void);
+void mem_init_heap(size_t max_heap);
 void mem_deinit(void);
 void *mem_sbrk(size_t incr);
+int mem_trim(size_t decr);
 void mem_reset_brk(void);
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+size_t mem_peak_heapsize(void);
 size_t mem_pagesize(void);
 
+#ifdef __cplusplus
+}
+#endif
@@ -3,9 +3,17 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <unistd.h>
+#include <string.h>
+#include <stddef.h>
+#include <limits.h>
+#include <stdint.h>
 
 #include "memlib.h"
+
+/* mm.c defines the out-of-line mm_malloc, so skip the inline wrapper */
+#define MM_NO_INLINE
 #include "mm.h"
+#include "size_classes.h"
 
 
 #define UNSCALED_POINTER_ADD(p, x) ((void*)((char*)(p) + (x)))
@@ -49,14 +57,126 @@ static Block* malloc_list_tail = NULL;
 
 static size_t heap_size = 0;
 
+/* Bytes already obtained from memlib but not yet carved into blocks. This
+ * fresh region starts right after the last block, at heap_size, so
+ * requestMoreSpace can serve most heap growth by bumping heap_size. */
+static size_t fresh_size = 0;
+
+/* Bit c is set while the free list holds a block of size class c. */
+static unsigned int free_class_mask = 0;
+
+/* Heap counters reported by mm_get_stats. */
+static mm_stats_t stats;
+
+/* Hot-path histograms. INSTR(...) compiles to nothing unless the
+ * allocator is built with -DMM_INSTRUMENT. */
+#ifdef MM_INSTRUMENT
+static mm_instr_t instr;
+#define INSTR(stmt) stmt
+#else
+#define INSTR(stmt)
+#endif
+
 /* Size of a word on this architecture. */
 #define WORD_SIZE sizeof(void*)
 
+/* Size of the chunks that make up the short-lived heap, and the largest
+ * request it serves; anything bigger goes to the main heap. */
+#define SHORT_CHUNK_SIZE (16 * 1024)
+#define SHORT_MAX (SHORT_CHUNK_SIZE / 8)
+
+/* Smallest chunk an arena takes from the heap, and the most it takes for
+ * a slab of small objects; a single larger request gets a chunk of its
+ * own size. */
+#define ARENA_CHUNK_SIZE (8 * 1024)
+#define ARENA_MAX_CHUNK (64 * 1024)
+
+/* Largest request the arena and aligned entry points take; keeps their
+ * size rounding, and the headers added to it, from overflowing. */
+#define MAX_REQUEST (PTRDIFF_MAX / 2)
+
+/* Marks the header size of an object in the short-lived heap. Block sizes
+ * are multiples of ALIGNMENT, so the low bit is otherwise always clear. */
+#define SHORT_LIVED_TAG 1
+
+/* Largest value accepted for the grow_chunk knob. */
+#define MAX_GROW (1 << 20)
+
 /* Alignment of blocks returned by mm_malloc.
  * (We need each allocation to at least be big enough for the free space
  * metadata... so let's just align by that.)  */
 #define ALIGNMENT (sizeof(FreeBlockInfo))
 
+/* The inline fast path in mm.h relies on this layout. */
+_Static_assert(ALIGNMENT == MM_ALIGNMENT, "mm.h MM_ALIGNMENT is stale");
+_Static_assert(sizeof(BlockInfo) == MM_HEADER_SIZE, "mm.h MM_HEADER_SIZE is stale");
+_Static_assert(offsetof(Block, freeNode.nextFree) == MM_HEADER_SIZE,
+               "fast bins must link through the first payload word");
+
+/* Recently freed small blocks, one bin per ALIGNMENT-sized payload up to
+ * MM_FASTBIN_LIMIT, kept marked as allocated and uncoalesced so a request
+ * of the same size can reuse them without a search. Linked through
+ * freeNode.nextFree. Blocks in the bins still count towards
+ * stats.bytes_in_use; mm_get_stats takes bytes_cached out again. Shared
+ * with the inline mm_malloc in mm.h. */
+mm_fastbins_t mm_fastbins;
+
+/* Runtime knobs, read and set through mm_ctl. They survive mm_init. */
+static size_t alignment = ALIGNMENT;          /* read-only */
+static size_t split_threshold = ALIGNMENT;    /* smallest remainder to split off */
+static size_t grow_chunk = 0;                 /* smallest heap extension, 0 = exact */
+static size_t fastbin_max = 0;                /* largest fast-bin payload, 0 = off */
+static size_t trim_threshold = 0;             /* free tail that is returned, 0 = never */
+static size_t fit_policy = MM_FIT_FIRST;      /* how searchFreeList picks a block */
+static size_t adaptive = 0;                   /* pick the policy from the workload */
+static size_t policy = 0;                     /* read-only: current policies[] entry */
+
+/* ADAPTIVE POLICY
+ *
+ * With the "adaptive" knob set, mm_malloc samples request sizes and free
+ * list search lengths over windows of ADAPT_WINDOW requests. At the start
+ * of the next request (a safe point: no search or split is in progress)
+ * it switches fit_policy and fastbin_max to one of the variants below.
+ */
+#define ADAPT_WINDOW 1024
+
+/* Requests up to this payload size count as small objects. */
+#define ADAPT_SMALL 256
+
+/* Searches visiting at most this many blocks on average count as cheap. */
+#define ADAPT_CHEAP_SEARCH 8
+
+/* Best fit visits the whole free list, so it is only used while the list
+ * holds at most this many blocks. */
+#define ADAPT_SHORT_LIST 256
+
+typedef struct {
+  size_t fitPolicy;
+  size_t fastbinMax;
+} Policy;
+
+static const Policy policies[] = {
+  { MM_FIT_FIRST, 0 },            // general purpose: the static default
+  { MM_FIT_FIRST, ADAPT_SMALL },  // mostly small objects: cache them in fast bins
+  { MM_FIT_BEST,  0 },            // short free list: best fit is cheap, packs tighter
+};
+
+/* What the current window has seen so far. */
+static struct {
+  size_t requests;  // mm_malloc calls
+  size_t small;     // ... of at most ADAPT_SMALL bytes
+  size_t searches;  // searchFreeList calls
+  size_t visited;   // free blocks visited by those searches
+} window;
+
+/* fit_policy and fastbin_max as the user left them when the adaptive
+ * mode took over; they come back when it is switched off. */
+static Policy user_policy;
+
+/* Payload size of a block regardless of whether it is free or in use. */
+#define BLOCK_SIZE(block) \
+  ((size_t)((block)->info.size < 0 ? -(block)->info.size : (block)->info.size))
+
 /* This function will have the OS allocate more space for our heap.
  *
  * It returns a pointer to that new space. That pointer will always be
@@ -91,6 +211,67 @@ void removeBlock(Block* block);
 
 void addBlock(Block* block);
 
+/* Map a payload size to its mm_get_stats size class. The class bounds
+ * are generated into size_classes.h from size_class_spec.hpp. Requests
+ * are never rounded up to a class bound: classes only group free blocks
+ * for the stats and the may_fit mask, and size arena chunks. */
+static int size_class(size_t size) {
+  int sizeClass;
+
+  if (size <= MM_CLASS_LOOKUP_LIMIT) {
+    return mm_class_lookup[(size + ALIGNMENT - 1) / ALIGNMENT];
+  }
+
+  // walk the classes above the lookup table
+  sizeClass = mm_class_lookup[MM_CLASS_LOOKUP_LIMIT / ALIGNMENT];
+  while (sizeClass < MM_NUM_SIZE_CLASSES - 1 && size > mm_class_max[sizeClass]) {
+    sizeClass++;
+  }
+
+  return sizeClass;
+}
+
+#ifdef MM_INSTRUMENT
+/* Map a search length to its histogram bucket. */
+static int hist_bucket(size_t visited) {
+  int bucket = 0;
+
+  while (visited && bucket < MM_HIST_BUCKETS - 1) {
+    visited >>= 1;
+    bucket++;
+  }
+
+  return bucket;
+}
+#endif
+
+/* Account for a block entering the free list. */
+static void stats_add_free(Block* block) {
+  int sizeClass = size_class(BLOCK_SIZE(block));
+
+  stats.bytes_free += BLOCK_SIZE(block);
+  if (stats.free_blocks[sizeClass]++ == 0) {
+    free_class_mask |= 1u << sizeClass;
+  }
+}
+
+/* Account for a block leaving the free list. */
+static void stats_remove_free(Block* block) {
+  int sizeClass = size_class(BLOCK_SIZE(block));
+
+  stats.bytes_free -= BLOCK_SIZE(block);
+  if (--stats.free_blocks[sizeClass] == 0) {
+    free_class_mask &= ~(1u << sizeClass);
+  }
+}
+
+/* Whether the free list might hold a block of at least reqSize bytes.
+ * Constant time: blocks in a higher size class than reqSize always fit,
+ * blocks in the same class only might. */
+static int may_fit(size_t reqSize) {
+  return (free_class_mask >> size_class(reqSize)) != 0;
+}
+
 Block* searchList(size_t reqSize) {
   Block* ptrFreeBlock = first_block();
   long int checkSize = -reqSize;
@@ -110,24 +291,95 @@ Block* searchList(size_t reqSize) {
 }
 
 /* Find a free block of at least the requested size in the free list.  Returns
-   NULL if no free block is large enough. */
+   NULL if no free block is large enough. Under MM_FIT_FIRST the first large
+   enough block wins; under MM_FIT_BEST the smallest one does. */
 Block* searchFreeList(size_t reqSize) {
   Block * ptrFreeBlock = free_list_head;
+  Block * bestBlock = NULL;
   long int checkSize = -(reqSize);
+  size_t visited = 0;
+#ifdef MM_INSTRUMENT
+  const int counting = 1;
+#else
+  const int counting = adaptive != 0;  // only the adaptive mode needs the count
+#endif
 
   // loop through the free blocks
   while(ptrFreeBlock != NULL){
+    if (counting) {
+      visited++;
+    }
     // check if free block is large enough
     if(ptrFreeBlock->info.size <= checkSize){
       /* Free block is large enough */
-      return ptrFreeBlock;
+      if (fit_policy == MM_FIT_FIRST || ptrFreeBlock->info.size == checkSize) {
+        // first fit, or nothing can beat an exact fit
+        bestBlock = ptrFreeBlock;
+        break;
+      }
+
+      if (bestBlock == NULL || ptrFreeBlock->info.size > bestBlock->info.size) {
+        // smaller than the best block so far
+        bestBlock = ptrFreeBlock;
+      }
     }
     // Find the next free block available
     ptrFreeBlock = ptrFreeBlock->freeNode.nextFree;
   }
 
-  // No free block large enough
-  return NULL;
+  if (adaptive) {
+    window.searches++;
+    window.visited += visited;
+  }
+  INSTR(instr.search_len[hist_bucket(visited)]++;)
+  return bestBlock;
+}
+
+/* Return every block cached in the fast bins to the free list. */
+static void consolidate(void);
+
+/* Split the unused end off an allocated block. */
+static Block* split_block(Block* ptrFreeBlock, size_t reqSize);
+
+/* Switch fit_policy and fastbin_max to the policies[] entry next. */
+static void set_policy(size_t next) {
+  if (policies[next].fastbinMax < fastbin_max) {
+    // blocks cached under the old limit go back to the free list
+    consolidate();
+  }
+
+  fit_policy = policies[next].fitPolicy;
+  fastbin_max = policies[next].fastbinMax;
+  policy = next;
+}
+
+/* Pick the policy for the next window from what the last one observed. */
+static void adapt(void) {
+  size_t next;
+  size_t freeBlocks = 0;
+  int i;
+
+  for (i = 0; i < MM_NUM_SIZE_CLASSES; i++) {
+    freeBlocks += stats.free_blocks[i];
+  }
+
+  if (window.small * 2 >= window.requests) {
+    // at least half of the requests were small
+    next = 1;
+  } else if (window.visited <= window.searches * ADAPT_CHEAP_SEARCH &&
+             freeBlocks <= ADAPT_SHORT_LIST) {
+    // searching is cheap enough to look for the best fit
+    next = 2;
+  } else {
+    next = 0;
+  }
+
+  if (next != policy) {
+    set_policy(next);
+    stats.policy_switches++;
+  }
+
+  window.requests = window.small = window.searches = window.visited = 0;
 }
 
 
@@ -139,7 +391,6 @@ Block* searchFreeList(size_t reqSize) {
  */
 void* mm_malloc(size_t size) {
   Block* ptrFreeBlock = NULL;
-  Block * splitBlock = NULL;
   long int reqSize;
 
   // Zero-size requests get NULL.
@@ -153,15 +404,47 @@ void* mm_malloc(size_t size) {
   // Round up for correct alignment
   reqSize = ALIGNMENT * ((reqSize + ALIGNMENT - 1) / ALIGNMENT);
 
+  /* ADAPTIVE POLICY */
+  if (adaptive) {
+    if (window.requests >= ADAPT_WINDOW) {
+      adapt();
+    }
+    window.requests++;
+    window.small += reqSize <= ADAPT_SMALL;
+  }
+
+  /* FAST BINS */
+  if (reqSize <= fastbin_max && mm_fastbins.bins[reqSize / ALIGNMENT]) {
+    // A block of exactly this size was freed recently: reuse it
+    ptrFreeBlock = mm_fastbins.bins[reqSize / ALIGNMENT];
+    mm_fastbins.bins[reqSize / ALIGNMENT] = ptrFreeBlock->freeNode.nextFree;
+    mm_fastbins.bytes_cached -= reqSize;
 
+    return UNSCALED_POINTER_ADD(ptrFreeBlock, sizeof(BlockInfo));
+  }
 
-  // Find best fit in the FREE LIST
-  ptrFreeBlock = searchFreeList(reqSize);
+
+  // Find best fit in the FREE LIST, unless no free block is large enough
+  if (may_fit(reqSize)) {
+    ptrFreeBlock = searchFreeList(reqSize);
+  }
+
+  if (ptrFreeBlock == NULL && mm_fastbins.bytes_cached) {
+    // Merge the fast bins back into the FREE LIST before growing the heap
+    consolidate();
+    if (may_fit(reqSize)) {
+      ptrFreeBlock = searchFreeList(reqSize);
+    }
+  }
 
 
   if (ptrFreeBlock == NULL) {
-    // reqSize too big: request more space
+    // reqSize too big: bump-allocate from the fresh region
     ptrFreeBlock = requestMoreSpace(reqSize + sizeof(BlockInfo));
+    if (ptrFreeBlock == NULL) {
+      /* Out of memory */
+      return NULL;
+    }
 
     // Initialize the new block and add to ALLOCATED LIST
     ptrFreeBlock->info.size = reqSize;
@@ -181,7 +464,26 @@ void* mm_malloc(size_t size) {
 
 
   /* SPLIT BLOCK */
-   if (ptrFreeBlock->info.size > reqSize + sizeof(BlockInfo)) {
+  split_block(ptrFreeBlock, reqSize);
+
+  stats.bytes_in_use += ptrFreeBlock->info.size;
+
+  return UNSCALED_POINTER_ADD(ptrFreeBlock, sizeof(BlockInfo));
+}
+
+/* Shrink the allocated block ptrFreeBlock to reqSize bytes if the rest is
+ * large enough to stand as a free block of its own. Returns the split,
+ * FREE block, or NULL if the block was left whole. */
+static Block* split_block(Block* ptrFreeBlock, size_t reqSize) {
+  Block * splitBlock = NULL;
+  size_t blockSize = (size_t) ptrFreeBlock->info.size;
+  int split;
+
+  // subtract rather than add, so a huge split_threshold cannot wrap
+  split = blockSize >= reqSize + sizeof(BlockInfo) &&
+          blockSize - reqSize - sizeof(BlockInfo) >= split_threshold;
+  INSTR(instr.split[split]++;)
+   if (split) {
 
    // Initialize next block of the split block
     Block * nextBlock = next_block(ptrFreeBlock);
@@ -211,9 +513,10 @@ void* mm_malloc(size_t size) {
 
     // Add the split, FREE block to the FREE list
     addBlock(splitBlock);
+    stats.splits++;
   }
 
-  return UNSCALED_POINTER_ADD(ptrFreeBlock, sizeof(BlockInfo));
+  return splitBlock;
 }
 
 
@@ -222,6 +525,7 @@ void coalesce(Block* blockInfo) {
   // Initialize pointers to the sides of block
   Block * nextBlock = next_block(blockInfo);
   Block * previousBlock = blockInfo->info.prev;
+  INSTR(int merged = 0;)
 
 
   /* NEXT ADJACENT BLOCK */
@@ -232,7 +536,11 @@ void coalesce(Block* blockInfo) {
     removeBlock(nextBlock);
 
     // Coalesce block with next block
+    stats_remove_free(blockInfo);
     blockInfo->info.size += nextBlock->info.size - sizeof(BlockInfo);
+    stats_add_free(blockInfo);
+    stats.coalesces++;
+    INSTR(merged++;)
 
     if(nextBlock == malloc_list_tail){
       /* Coalescing at the end of the list */
@@ -267,7 +575,11 @@ void coalesce(Block* blockInfo) {
     removeBlock(nextBlock);
 
     // Coalesce with previous block with main block
+    stats_remove_free(blockInfo);
     blockInfo->info.size += nextBlock->info.size - sizeof(BlockInfo);
+    stats_add_free(blockInfo);
+    stats.coalesces++;
+    INSTR(merged++;)
 
     if(nextBlock == malloc_list_tail){
       /* Coalescing at the end */
@@ -288,13 +600,29 @@ void coalesce(Block* blockInfo) {
       }
     }
   }
+
+  INSTR(instr.merges[merged]++;)
 }
 
-/* Free the block referenced by ptr. */
-void mm_free(void* ptr) {
+/* Give the free block at the end of the heap back to memlib. */
+static void trim(void) {
+  Block* tail = malloc_list_tail;
+  size_t tailSize = BLOCK_SIZE(tail) + sizeof(BlockInfo);
+
+  // Drop the tail from the FREE LIST and the heap, along with the fresh
+  // region above it
+  removeBlock(tail);
+  malloc_list_tail = tail->info.prev;
+  heap_size -= tailSize;
+  mem_trim(tailSize + fresh_size);
+  fresh_size = 0;
+
+  stats.heap_size = heap_size;
+  stats.bytes_fresh = 0;
+}
 
-  // Get the header information of the block being freed
-  Block* blockInfo = (Block*) UNSCALED_POINTER_SUB(ptr, sizeof(BlockInfo));
+/* Move an allocated block onto the FREE LIST and merge its free neighbours. */
+static void release(Block* blockInfo) {
 
   // Make the block free
   blockInfo->info.size = -blockInfo->info.size;
@@ -305,6 +633,778 @@ void mm_free(void* ptr) {
   // coalesce adjacent free blocks
   coalesce(blockInfo);
 
+  if (trim_threshold && malloc_list_tail->info.size < 0 &&
+      BLOCK_SIZE(malloc_list_tail) >= trim_threshold) {
+    // The free tail of the heap is large enough to give back
+    trim();
+  }
+}
+
+/* Free an object that mm_malloc_hint placed in the short-lived heap. */
+static void short_free(Block* block);
+
+/* Short-lived objects allocated and not yet freed or reset. While there
+ * are none, no block can carry SHORT_LIVED_TAG. */
+static size_t short_live = 0;
+
+/* Free the block referenced by ptr. */
+void mm_free(void* ptr) {
+
+  // Get the header information of the block being freed
+  Block* blockInfo = (Block*) UNSCALED_POINTER_SUB(ptr, sizeof(BlockInfo));
+
+  if (blockInfo->info.size & SHORT_LIVED_TAG) {
+    // Object lives in a short-lived chunk, not directly in the heap
+    short_free(blockInfo);
+    return;
+  }
+
+  if (blockInfo->info.size <= fastbin_max) {
+    // Small block: cache it in its fast bin without coalescing
+    blockInfo->freeNode.nextFree = mm_fastbins.bins[blockInfo->info.size / ALIGNMENT];
+    mm_fastbins.bins[blockInfo->info.size / ALIGNMENT] = blockInfo;
+    mm_fastbins.bytes_cached += blockInfo->info.size;
+    return;
+  }
+
+  stats.bytes_in_use -= blockInfo->info.size;
+  release(blockInfo);
+}
+
+/* Free the block referenced by ptr, which the caller allocated with
+ * mm_malloc(size). The block holds at least size bytes rounded up, so a
+ * size within fastbin_max sends it to that size's fast bin without its
+ * header being read, as long as no short-lived object (whose header is
+ * tagged) is live. Larger blocks skip straight to coalescing, which has
+ * to read the boundary tags. */
+void mm_free_sized(void* ptr, size_t size) {
+  Block* blockInfo = (Block*) UNSCALED_POINTER_SUB(ptr, sizeof(BlockInfo));
+  size_t reqSize = ALIGNMENT * ((size + ALIGNMENT - 1) / ALIGNMENT);
+
+  assert(size <= mm_usable_size(ptr));
+
+  if (reqSize == 0 || (short_live && reqSize <= SHORT_MAX)) {
+    // Might be a short-lived object: only its header can tell
+    mm_free(ptr);
+    return;
+  }
+
+  if (reqSize <= fastbin_max) {
+    // Small block: cache it in the fast bin for its requested size
+    blockInfo->freeNode.nextFree = mm_fastbins.bins[reqSize / ALIGNMENT];
+    mm_fastbins.bins[reqSize / ALIGNMENT] = blockInfo;
+    mm_fastbins.bytes_cached += reqSize;
+    return;
+  }
+
+  stats.bytes_in_use -= blockInfo->info.size;
+  release(blockInfo);
+}
+
+/* Take a free block of at least reqSize bytes off the FREE LIST and trim
+ * it to size, merging the fast bins back in first if nothing fits.
+ * Returns NULL, without growing the heap, if no free block fits. */
+static Block* take_free_block(size_t reqSize) {
+  Block* block = NULL;
+
+  if (may_fit(reqSize)) {
+    block = searchFreeList(reqSize);
+  }
+  if (block == NULL && mm_fastbins.bytes_cached) {
+    consolidate();
+    if (may_fit(reqSize)) {
+      block = searchFreeList(reqSize);
+    }
+  }
+  if (block == NULL) {
+    return NULL;
+  }
+
+  // FREE ---> ALLOCATED
+  block->info.size = -block->info.size;
+  removeBlock(block);
+  split_block(block, reqSize);
+  stats.bytes_in_use += block->info.size;
+
+  return block;
+}
+
+/* Count blocks requests of reqSize bytes in the adaptive window. */
+static void adapt_count(size_t reqSize, size_t blocks) {
+  window.requests += blocks;
+  if (reqSize <= ADAPT_SMALL) {
+    window.small += blocks;
+  }
+}
+
+/* Allocate n blocks of size bytes into ptrs, stopping early if the heap
+ * runs out. Returns how many were allocated.
+ *
+ * Blocks cached in the fast bin for this size are handed out first. The
+ * rest are carved back to back out of one free block large enough for
+ * all of them, so the batch costs one search and one split rather than
+ * one of each per block. Without such a block, free blocks that fit a
+ * single block serve the batch one at a time until none is left, and
+ * the rest is carved out of a single heap extension. */
+int mm_malloc_batch(size_t size, void** ptrs, int n) {
+  Block* block = NULL;
+  Block* next;
+  size_t reqSize;
+  size_t total;
+  size_t left;
+  int i = 0;
+
+  if (size == 0 || n <= 0) {
+    return 0;
+  }
+
+  // Round up for correct alignment
+  reqSize = ALIGNMENT * ((size + ALIGNMENT - 1) / ALIGNMENT);
+
+  /* ADAPTIVE POLICY */
+  if (adaptive && window.requests >= ADAPT_WINDOW) {
+    adapt();
+  }
+
+  /* FAST BINS */
+  while (i < n && reqSize <= fastbin_max && mm_fastbins.bins[reqSize / ALIGNMENT]) {
+    block = mm_fastbins.bins[reqSize / ALIGNMENT];
+    mm_fastbins.bins[reqSize / ALIGNMENT] = block->freeNode.nextFree;
+    mm_fastbins.bytes_cached -= reqSize;
+    ptrs[i++] = UNSCALED_POINTER_ADD(block, sizeof(BlockInfo));
+  }
+  if (adaptive) {
+    adapt_count(reqSize, i);
+  }
+
+  left = n - i;
+  if (left == 0) {
+    return n;
+  }
+  if (left > (size_t)LONG_MAX / (reqSize + sizeof(BlockInfo))) {
+    // Too large to carve as one block: allocate block by block
+    for (; i < n; i++) {
+      if ((ptrs[i] = mm_malloc(size)) == NULL) {
+        break;
+      }
+    }
+    return i;
+  }
+
+  // One payload that holds all the blocks, less the first block's header
+  total = left * (reqSize + sizeof(BlockInfo)) - sizeof(BlockInfo);
+  block = NULL;
+  if (may_fit(total)) {
+    block = searchFreeList(total);
+  }
+
+  if (block != NULL) {
+    // FREE ---> ALLOCATED
+    block->info.size = -block->info.size;
+    removeBlock(block);
+
+  } else {
+    // Use up free blocks that fit one block first, so the batch does not
+    // grow the heap while they could serve it
+    while (i < n && (block = take_free_block(reqSize)) != NULL) {
+      ptrs[i++] = UNSCALED_POINTER_ADD(block, sizeof(BlockInfo));
+      if (adaptive) {
+        adapt_count(reqSize, 1);
+      }
+    }
+
+    left = n - i;
+    if (left == 0) {
+      return n;
+    }
+
+    // The rest comes from one heap extension
+    total = left * (reqSize + sizeof(BlockInfo)) - sizeof(BlockInfo);
+    block = requestMoreSpace(total + sizeof(BlockInfo));
+    if (block == NULL) {
+      /* Out of memory */
+      return i;
+    }
+    block->info.size = total;
+    block->info.prev = malloc_list_tail;
+    malloc_list_tail = block;
+  }
+
+  if (adaptive) {
+    adapt_count(reqSize, left);
+  }
+
+  /* SPLIT BLOCK */
+  split_block(block, total);
+
+  // Payload bytes only: the headers carved out below are not in use
+  stats.bytes_in_use += block->info.size - (left - 1) * sizeof(BlockInfo);
+
+  // Carve the batch front to back; the last block keeps any slack
+  while (--left) {
+    next = (Block*) UNSCALED_POINTER_ADD(block, reqSize + sizeof(BlockInfo));
+    next->info.size = block->info.size - (reqSize + sizeof(BlockInfo));
+    next->info.prev = block;
+    block->info.size = reqSize;
+    ptrs[i++] = UNSCALED_POINTER_ADD(block, sizeof(BlockInfo));
+    block = next;
+  }
+  ptrs[i++] = UNSCALED_POINTER_ADD(block, sizeof(BlockInfo));
+
+  /* LIST'S TAIL LOCATION */
+  if ((next = next_block(block)) != NULL) {
+    next->info.prev = block;
+  } else {
+    malloc_list_tail = block;
+  }
+
+  return n;
+}
+
+/* Return every block cached in the fast bins to the free list. A block
+ * counts in bytes_cached by the size of its bin, which mm_free_sized may
+ * have picked below the block's own size. */
+static void consolidate(void) {
+  size_t i;
+  Block* block;
+
+  for (i = 0; i < MM_NUM_FASTBINS; i++) {
+    while ((block = mm_fastbins.bins[i]) != NULL) {
+      mm_fastbins.bins[i] = block->freeNode.nextFree;
+      mm_fastbins.bytes_cached -= i * ALIGNMENT;
+      stats.bytes_in_use -= block->info.size;
+      release(block);
+    }
+  }
+}
+
+/* Allocate size bytes whose address is a multiple of align, a power of
+ * two. Returns NULL if size is zero or too large, or if align is not a
+ * power of two. The block is freed with mm_free as usual. */
+void* mm_memalign(size_t align, size_t size) {
+  Block* block;
+  Block* alignedBlock;
+  Block* nextBlock;
+  Block* splitBlock;
+  char* payload;
+  size_t lead = 0;
+
+  if (align & (align - 1)) {
+    /* Not a power of two */
+    return NULL;
+  }
+
+  if (size > MAX_REQUEST || align > MAX_REQUEST) {
+    // The padded request below would overflow
+    return NULL;
+  }
+
+  if (align <= ALIGNMENT) {
+    // Every block is ALIGNMENT-aligned already
+    return mm_malloc(size);
+  }
+
+  if (size == 0) {
+    return NULL;
+  }
+
+  // Leave room for an aligned payload after a minimal free block
+  payload = mm_malloc(size + align + sizeof(BlockInfo) + ALIGNMENT);
+  if (payload == NULL) {
+    return NULL;
+  }
+  block = (Block*) UNSCALED_POINTER_SUB(payload, sizeof(BlockInfo));
+
+  if ((size_t)payload & (align - 1)) {
+    // First aligned payload address that leaves a valid free block in front
+    lead = align - ((size_t)payload & (align - 1));
+    while (lead < sizeof(BlockInfo) + ALIGNMENT) {
+      lead += align;
+    }
+  }
+
+  /* SPLIT OFF THE UNUSED TAIL */
+  stats.bytes_in_use -= block->info.size;
+  splitBlock = split_block(block, lead + ALIGNMENT * ((size + ALIGNMENT - 1) / ALIGNMENT));
+  if (splitBlock) {
+    coalesce(splitBlock);
+  }
+  stats.bytes_in_use += block->info.size;
+
+  if (lead == 0) {
+    /* Payload happens to be aligned */
+    return payload;
+  }
+
+  /* SPLIT OFF THE LEADING BLOCK */
+
+  // Initialize next block of the original block
+  nextBlock = next_block(block);
+
+  // The aligned block takes everything after the lead
+  alignedBlock = (Block*) UNSCALED_POINTER_ADD(block, lead);
+  alignedBlock->info.size = block->info.size - lead;
+  alignedBlock->info.prev = block;
+
+  if (malloc_list_tail == block) {
+    // aligned block is the end of the list
+    malloc_list_tail = alignedBlock;
+  } else {
+    // link aligned block to rest of list
+    nextBlock->info.prev = alignedBlock;
+  }
+
+  // The leading block becomes FREE
+  stats.bytes_in_use -= lead;
+  block->info.size = -(long int)(lead - sizeof(BlockInfo));
+  addBlock(block);
+  coalesce(block);
+
+  return UNSCALED_POINTER_ADD(alignedBlock, sizeof(BlockInfo));
+}
+
+/* Resize the block referenced by ptr to size bytes, keeping its contents.
+ * Blocks shrink in place and grow in place into a free next block or the
+ * fresh region when they can; otherwise the contents move to a new
+ * block. realloc(NULL, size) is mm_malloc and realloc(ptr, 0) is mm_free.
+ * Returns NULL, leaving ptr untouched, if there is no room to grow. */
+void* mm_realloc(void* ptr, size_t size) {
+  Block* block;
+  Block* nextBlock;
+  Block* splitBlock;
+  size_t reqSize;
+  size_t oldSize;
+  void* newPtr;
+
+  if (ptr == NULL) {
+    return mm_malloc(size);
+  }
+  if (size == 0) {
+    mm_free(ptr);
+    return NULL;
+  }
+
+  block = (Block*) UNSCALED_POINTER_SUB(ptr, sizeof(BlockInfo));
+  oldSize = block->info.size & ~SHORT_LIVED_TAG;
+
+  // Round up for correct alignment
+  reqSize = ALIGNMENT * ((size + ALIGNMENT - 1) / ALIGNMENT);
+
+  if (!(block->info.size & SHORT_LIVED_TAG)) {
+    /* Block lives directly in the heap */
+    stats.bytes_in_use -= oldSize;
+
+    nextBlock = next_block(block);
+    if (reqSize > oldSize && nextBlock && nextBlock->info.size < 0 &&
+        oldSize + sizeof(BlockInfo) + BLOCK_SIZE(nextBlock) >= reqSize) {
+      // Grow into the free next block
+      removeBlock(nextBlock);
+      block->info.size += sizeof(BlockInfo) + BLOCK_SIZE(nextBlock);
+      stats.coalesces++;
+
+      if (nextBlock == malloc_list_tail) {
+        malloc_list_tail = block;
+      } else {
+        next_block(block)->info.prev = block;
+      }
+    } else if (reqSize > oldSize && block == malloc_list_tail &&
+               requestMoreSpace(reqSize - oldSize) != NULL) {
+      // Grow the tail of the heap into the fresh region
+      block->info.size = reqSize;
+    }
+
+    if ((size_t)block->info.size >= reqSize) {
+      // The block holds the new size: give back what it does not need
+      splitBlock = split_block(block, reqSize);
+      if (splitBlock) {
+        coalesce(splitBlock);
+      }
+      stats.bytes_in_use += block->info.size;
+      return ptr;
+    }
+
+    stats.bytes_in_use += oldSize;
+  } else if (reqSize <= oldSize) {
+    /* Short-lived objects can only shrink in place */
+    return ptr;
+  }
+
+  // Move the contents to a block large enough
+  newPtr = mm_malloc(size);
+  if (newPtr == NULL) {
+    return NULL;
+  }
+  memcpy(newPtr, ptr, oldSize < size ? oldSize : size);
+  mm_free(ptr);
+
+  return newPtr;
+}
+
+/* Number of payload bytes usable in the block referenced by ptr, which is
+ * at least the size it was allocated with. */
+size_t mm_usable_size(void* ptr) {
+  Block* block = (Block*) UNSCALED_POINTER_SUB(ptr, sizeof(BlockInfo));
+
+  return block->info.size & ~SHORT_LIVED_TAG;
+}
+
+// LIFETIME HINTS ---------------------------------------------------
+//
+// Objects hinted MM_SHORT_LIVED are bump-allocated from chunks that are
+// themselves ordinary blocks of the heap, so their churn never splits or
+// coalesces heap blocks. The separation is per chunk: a chunk sits among
+// long-lived blocks like any other 16KB block, but no long-lived block is
+// ever placed between two short-lived objects, and an emptied chunk goes
+// back to the heap as one free block. Each object still carries a
+// BlockInfo header: its size is tagged with SHORT_LIVED_TAG and its prev
+// field points at the owning chunk. A chunk counts its live objects and
+// is rewound (or handed back to the heap) as soon as that count drops to
+// zero; mm_short_reset drops all of them at once.
+
+/* Header at the start of every short-lived chunk's payload. */
+typedef struct _Chunk {
+  struct _Chunk* next;  // next (older) chunk
+  struct _Chunk* prev;  // previous (newer) chunk, NULL for the current one
+  char* bump;           // first unused byte
+  char* end;            // one past the last usable byte
+  size_t live;          // objects allocated and not yet freed
+  size_t pad;           // keeps the first object ALIGNMENT-aligned
+} Chunk;
+
+/* The current chunk, followed by older chunks that still hold objects. */
+static Chunk* short_chunks = NULL;
+
+/* Start a new current chunk for the short-lived heap. Returns NULL if the
+ * heap is out of memory. */
+static Chunk* short_new_chunk(void) {
+  Chunk* chunk = mm_malloc(SHORT_CHUNK_SIZE);
+
+  if (chunk == NULL) {
+    /* Out of memory */
+    return NULL;
+  }
+
+  chunk->bump = UNSCALED_POINTER_ADD(chunk, sizeof(Chunk));
+  chunk->end = UNSCALED_POINTER_ADD(chunk, SHORT_CHUNK_SIZE);
+  chunk->live = 0;
+  chunk->prev = NULL;
+  chunk->next = short_chunks;
+  if (short_chunks) {
+    short_chunks->prev = chunk;
+  }
+  short_chunks = chunk;
+
+  return chunk;
+}
+
+/* Bump-allocate reqSize payload bytes from the short-lived heap. */
+static void* short_malloc(size_t reqSize) {
+  Chunk* chunk = short_chunks;
+  Block* block;
+
+  if (chunk == NULL ||
+      chunk->bump + sizeof(BlockInfo) + reqSize > chunk->end) {
+    // Current chunk is missing or full
+    chunk = short_new_chunk();
+    if (chunk == NULL) {
+      return NULL;
+    }
+  }
+
+  block = (Block*)chunk->bump;
+  block->info.size = reqSize | SHORT_LIVED_TAG;
+  block->info.prev = (Block*)chunk;
+  chunk->bump += sizeof(BlockInfo) + reqSize;
+  chunk->live++;
+  short_live++;
+
+  return UNSCALED_POINTER_ADD(block, sizeof(BlockInfo));
+}
+
+static void short_free(Block* block) {
+  Chunk* chunk = (Chunk*)block->info.prev;
+
+  short_live--;
+  if (--chunk->live > 0) {
+    /* Chunk still holds live objects */
+    return;
+  }
+
+  if (chunk == short_chunks) {
+    // Current chunk is empty: start over from its beginning
+    chunk->bump = UNSCALED_POINTER_ADD(chunk, sizeof(Chunk));
+    return;
+  }
+
+  // An older chunk emptied out: unlink it and return it to the heap
+  chunk->prev->next = chunk->next;
+  if (chunk->next) {
+    chunk->next->prev = chunk->prev;
+  }
+  mm_free(chunk);
+}
+
+/* Allocate size bytes, placing the object according to its expected
+ * lifetime. MM_SHORT_LIVED objects go to the short-lived heap, unless
+ * they are too large to share a chunk; everything else is mm_malloc. */
+void* mm_malloc_hint(size_t size, int hint) {
+  size_t reqSize;
+
+  if (size == 0 || !(hint & MM_SHORT_LIVED) || size > SHORT_MAX) {
+    return mm_malloc(size);
+  }
+
+  // Round up for correct alignment
+  reqSize = ALIGNMENT * ((size + ALIGNMENT - 1) / ALIGNMENT);
+
+  return short_malloc(reqSize);
+}
+
+/* Release every object in the short-lived heap at once. The current chunk
+ * is rewound for reuse and the older ones go back to the heap, so the
+ * cost is one step per chunk, not one mm_free per object. */
+void mm_short_reset(void) {
+  Chunk* chunk;
+  Chunk* next;
+
+  if (short_chunks == NULL) {
+    return;
+  }
+
+  chunk = short_chunks->next;
+  while (chunk) {
+    next = chunk->next;
+    mm_free(chunk);
+    chunk = next;
+  }
+
+  short_chunks->next = NULL;
+  short_chunks->live = 0;
+  short_live = 0;
+  short_chunks->bump = UNSCALED_POINTER_ADD(short_chunks, sizeof(Chunk));
+}
+
+// ARENAS -----------------------------------------------------------
+//
+// An arena hands out memory by bumping through a chain of chunks taken
+// from the heap with mm_malloc. Objects are never freed one by one:
+// mm_arena_reset rewinds the arena to its first chunk in constant time
+// and keeps the chain for reuse, and mm_arena_destroy gives every chunk
+// back to the heap.
+
+/* Header at the start of every arena chunk's payload. */
+typedef struct _ArenaChunk {
+  struct _ArenaChunk* next;  // next chunk in the chain
+  char* end;                 // one past the last usable byte
+} ArenaChunk;
+
+struct mm_arena {
+  ArenaChunk* first;    // first chunk of the chain, NULL until first use
+  ArenaChunk* current;  // chunk being bumped through
+  char* bump;           // first unused byte of current
+};
+
+/* Make chunk the current chunk and start at its beginning. */
+static void arena_enter(mm_arena_t* arena, ArenaChunk* chunk) {
+  arena->current = chunk;
+  arena->bump = UNSCALED_POINTER_ADD(chunk, sizeof(ArenaChunk));
+}
+
+/* Create an empty arena. Chunks are only taken from the heap once
+ * something is allocated in it. Returns NULL if the heap is out of
+ * memory. */
+mm_arena_t* mm_arena_create(void) {
+  mm_arena_t* arena = mm_malloc(sizeof(mm_arena_t));
+
+  if (arena == NULL) {
+    /* Out of memory */
+    return NULL;
+  }
+
+  arena->first = NULL;
+  arena->current = NULL;
+  arena->bump = NULL;
+
+  return arena;
+}
+
+/* Allocate size bytes from arena. The memory stays valid until the arena
+ * is reset or destroyed and must not be passed to mm_free. Returns NULL
+ * if size is 0 or too large, or if no chunk could be taken from the heap. */
+void* mm_arena_malloc(mm_arena_t* arena, size_t size) {
+  ArenaChunk* chunk;
+  size_t reqSize;
+  size_t chunkSize;
+  void* ret;
+
+  if (size == 0 || size > MAX_REQUEST) {
+    return NULL;
+  }
+
+  // Round up for correct alignment
+  reqSize = ALIGNMENT * ((size + ALIGNMENT - 1) / ALIGNMENT);
+
+  while (arena->current == NULL ||
+         reqSize > (size_t)(arena->current->end - arena->bump)) {
+    /* Current chunk cannot hold the request */
+
+    if (arena->current && arena->current->next) {
+      // Move on to a chunk kept from before the last reset
+      arena_enter(arena, arena->current->next);
+      continue;
+    }
+
+    // Grow the chain by a chunk large enough for the request, and for a
+    // slab's worth of requests its size, up to ARENA_MAX_CHUNK
+    chunkSize = mm_class_slab[size_class(reqSize)];
+    if (chunkSize > ARENA_MAX_CHUNK) {
+      chunkSize = ARENA_MAX_CHUNK;
+    }
+    if (chunkSize < sizeof(ArenaChunk) + reqSize) {
+      chunkSize = sizeof(ArenaChunk) + reqSize;
+    }
+    if (chunkSize < ARENA_CHUNK_SIZE) {
+      chunkSize = ARENA_CHUNK_SIZE;
+    }
+    chunk = mm_malloc(chunkSize);
+    if (chunk == NULL) {
+      /* Out of memory: the arena is left as it was */
+      return NULL;
+    }
+    chunk->next = NULL;
+    chunk->end = UNSCALED_POINTER_ADD(chunk, chunkSize);
+
+    if (arena->current) {
+      arena->current->next = chunk;
+    } else {
+      arena->first = chunk;
+    }
+    arena_enter(arena, chunk);
+  }
+
+  ret = arena->bump;
+  arena->bump += reqSize;
+
+  return ret;
+}
+
+/* Release everything allocated from arena at once. The chunks stay with
+ * the arena and are reused by later allocations. */
+void mm_arena_reset(mm_arena_t* arena) {
+  if (arena->first) {
+    arena_enter(arena, arena->first);
+  }
+}
+
+/* Release everything allocated from arena and return its chunks, and the
+ * arena itself, to the heap. */
+void mm_arena_destroy(mm_arena_t* arena) {
+  ArenaChunk* chunk = arena->first;
+  ArenaChunk* next;
+
+  while (chunk) {
+    next = chunk->next;
+    mm_free(chunk);
+    chunk = next;
+  }
+
+  mm_free(arena);
+}
+
+/* One knob reachable through mm_ctl. */
+typedef struct {
+  const char* name;  // key passed to mm_ctl
+  size_t* value;     // the variable behind it
+  size_t max;        // largest accepted value
+  int writable;      // zero for read-only knobs
+} CtlEntry;
+
+static CtlEntry ctl_table[] = {
+  { "alignment",       &alignment,       ALIGNMENT,        0 },
+  { "split_threshold", &split_threshold, (size_t)-1,       1 },
+  { "grow_chunk",      &grow_chunk,      MAX_GROW,         1 },
+  { "fastbin_max",     &fastbin_max,     MM_FASTBIN_LIMIT, 1 },
+  { "trim_threshold",  &trim_threshold,  (size_t)-1,       1 },
+  { "fit_policy",      &fit_policy,      MM_FIT_BEST,      1 },
+  { "adaptive",        &adaptive,        1,                1 },
+  { "policy",          &policy,          0,                0 },
+};
+
+/* Read and/or set the allocator knob called name. If oldp is not NULL the
+ * current value is stored there; if newp is not NULL the knob is set to
+ * *newp. Sizes are rounded up to ALIGNMENT. Returns 0 on success and -1
+ * for an unknown or read-only knob or an out-of-range value. */
+int mm_ctl(const char* name, size_t* oldp, const size_t* newp) {
+  size_t i;
+  size_t value;
+  CtlEntry* entry = NULL;
+
+  for (i = 0; i < sizeof(ctl_table) / sizeof(ctl_table[0]); i++) {
+    if (strcmp(ctl_table[i].name, name) == 0) {
+      entry = &ctl_table[i];
+      break;
+    }
+  }
+
+  if (entry == NULL) {
+    /* No such knob */
+    return -1;
+  }
+
+  if (oldp) {
+    *oldp = *entry->value;
+  }
+
+  if (newp) {
+    value = *newp;
+    if (!entry->writable || value > entry->max) {
+      return -1;
+    }
+
+    if (adaptive && (entry->value == &fit_policy || entry->value == &fastbin_max ||
+                     (entry->value == &adaptive && !value))) {
+      // a policy knob set by hand ends the adaptive mode: restore what the
+      // user had before it started, then apply the new value on top
+      adaptive = 0;
+      if (user_policy.fastbinMax < fastbin_max) {
+        consolidate();
+      }
+      fit_policy = user_policy.fitPolicy;
+      fastbin_max = user_policy.fastbinMax;
+      policy = 0;
+    } else if (!adaptive && entry->value == &adaptive && value) {
+      user_policy.fitPolicy = fit_policy;
+      user_policy.fastbinMax = fastbin_max;
+    }
+
+    if (entry->value != &fit_policy && entry->value != &adaptive) {
+      // every size-valued knob works in whole ALIGNMENT units; values
+      // too close to SIZE_MAX to round up are clamped to the largest one
+      if (value > (size_t)-1 - (ALIGNMENT - 1)) {
+        value = (size_t)-1 & ~(size_t)(ALIGNMENT - 1);
+      } else {
+        value = ALIGNMENT * ((value + ALIGNMENT - 1) / ALIGNMENT);
+      }
+    }
+    if (entry->value == &split_threshold && value < ALIGNMENT) {
+      // the split-off block must be able to hold its free list links
+      value = ALIGNMENT;
+    }
+
+    if (entry->value == &fastbin_max) {
+      // blocks cached under the old limit go back to the free list
+      consolidate();
+    }
+
+    *entry->value = value;
+
+    if (entry->value == &adaptive && value) {
+      // start from the general-purpose variant
+      set_policy(0);
+    }
+  }
+
+  return 0;
 }
 
 // PROVIDED FUNCTIONS -----------------------------------------------
@@ -320,6 +1420,8 @@ void addBlock(Block * block){
     return;
   }
 
+  stats_add_free(block);
+
   if(free_list_head == NULL){
     /* Free list is empty */
 
@@ -350,6 +1452,8 @@ void removeBlock(Block *block) {
   return;
  }
 
+  stats_remove_free(block);
+
   /* POINTER CHECK */
   if(block->freeNode.nextFree){
     /* Free next block exists */
@@ -381,17 +1485,38 @@ void removeBlock(Block *block) {
   }
 }
 
-/* Get more heap space of exact size reqSize. */
+/* Get more heap space of exact size reqSize by bumping the start of the
+ * fresh region. When the fresh region is too small it is first extended
+ * through mem_sbrk, by at least grow_chunk bytes. Returns NULL if memlib
+ * is out of memory. */
 void* requestMoreSpace(size_t reqSize) {
   void* ret = UNSCALED_POINTER_ADD(mem_heap_lo(), heap_size);
-  heap_size += reqSize;
 
-  void* mem_sbrk_result = mem_sbrk(reqSize);
-  if ((size_t)mem_sbrk_result == -1) {
-    printf("ERROR: mem_sbrk failed in requestMoreSpace\n");
-    exit(0);
+  if (fresh_size < reqSize) {
+    /* Fresh region is too small */
+    size_t growSize = reqSize - fresh_size;
+    if (growSize < grow_chunk) {
+      growSize = grow_chunk;
+    }
+
+    void* mem_sbrk_result = mem_sbrk(growSize);
+    if ((size_t)mem_sbrk_result == -1) {
+      return NULL;
+    }
+    fresh_size += growSize;
+
+    stats.sbrk_calls++;
+    stats.heap_size = heap_size + fresh_size;
+    if (stats.heap_size > stats.peak_heap_size) {
+      stats.peak_heap_size = stats.heap_size;
+    }
   }
 
+  // Bump: the new space moves from the fresh region into the heap
+  heap_size += reqSize;
+  fresh_size -= reqSize;
+  stats.bytes_fresh = fresh_size;
+
   return ret;
 }
 
@@ -400,10 +1525,51 @@ int mm_init() {
   free_list_head = NULL;
   malloc_list_tail = NULL;
   heap_size = 0;
+  fresh_size = 0;
+  free_class_mask = 0;
+  short_chunks = NULL;
+  short_live = 0;
+  memset(&mm_fastbins, 0, sizeof(mm_fastbins));
+  stats = (mm_stats_t){0};
+  memset(&window, 0, sizeof(window));
+  if (adaptive) {
+    set_policy(0);
+  }
+  INSTR(instr = (mm_instr_t){{0}};)
 
   return 0;
 }
 
+/* Report the heap counters maintained by the allocator. */
+void mm_get_stats(mm_stats_t *out) {
+  *out = stats;
+  out->bytes_cached = mm_fastbins.bytes_cached;
+  out->bytes_in_use -= mm_fastbins.bytes_cached;
+}
+
+/* Walk the heap in address order, handing each block to fn. */
+void mm_heap_walk(mm_walk_fn fn, void *arg) {
+  Block* curr = first_block();
+  mm_block_t block;
+
+  while (curr) {
+    block.payload = UNSCALED_POINTER_ADD(curr, sizeof(BlockInfo));
+    block.size = BLOCK_SIZE(curr);
+    block.overhead = sizeof(BlockInfo);
+    block.allocated = curr->info.size > 0;
+    fn(&block, arg);
+
+    curr = next_block(curr);
+  }
+}
+
+#ifdef MM_INSTRUMENT
+/* Report the hot-path histograms collected since mm_init. */
+void mm_get_instr(mm_instr_t *out) {
+  *out = instr;
+}
+#endif
+
 /* Gets the first block in the heap or returns NULL if there is not one. */
 Block* first_block() {
   Block* first = (Block*)mem_heap_lo();
@@ -1,5 +1,12 @@
+#ifndef MM_H
+#define MM_H
+
 #include <stdio.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 extern int mm_init(void);
 extern void *mm_malloc(size_t size);
 extern void mm_free(void *ptr);
@@ -7,3 +14,169 @@ extern void examine_heap();
 
 // Extra credit
 extern void* mm_realloc(void* ptr, size_t size);
+
+/* Payload bytes usable in the block ptr, at least its requested size. */
+extern size_t mm_usable_size(void *ptr);
+
+/* Allocate size bytes at an address that is a multiple of align, which
+ * must be a power of two. Free with mm_free. */
+extern void *mm_memalign(size_t align, size_t size);
+
+/* mm_free for a block the caller allocated with mm_malloc(size). While
+ * no MM_SHORT_LIVED object is live, a size within mm_ctl("fastbin_max")
+ * caches the block in a fast bin without reading its header. */
+extern void mm_free_sized(void *ptr, size_t size);
+
+/* Allocate n blocks of size bytes each into ptrs. Returns the number
+ * allocated, less than n only if the heap ran out. */
+extern int mm_malloc_batch(size_t size, void **ptrs, int n);
+
+/* Lifetime hints for mm_malloc_hint. */
+#define MM_SHORT_LIVED 1  /* freed soon, e.g. at the end of a request */
+#define MM_LONG_LIVED  2  /* kept for most of the life of the process */
+
+/* mm_malloc with a lifetime hint. Short-lived objects are kept apart from
+ * long-lived ones so their churn does not fragment the main heap. Free
+ * with mm_free as usual. Returns NULL if the heap is out of memory. */
+extern void *mm_malloc_hint(size_t size, int hint);
+
+/* Release every object allocated with MM_SHORT_LIVED at once, e.g. at the
+ * end of a request. Objects released this way must not be passed to
+ * mm_free afterwards. */
+extern void mm_short_reset(void);
+
+/* Arenas: bump allocators over chunks of the heap whose objects are all
+ * released together by mm_arena_reset (which keeps the chunks for reuse)
+ * or mm_arena_destroy (which returns them to the heap). Arena memory must
+ * not be passed to mm_free. */
+typedef struct mm_arena mm_arena_t;
+
+extern mm_arena_t *mm_arena_create(void);
+extern void *mm_arena_malloc(mm_arena_t *arena, size_t size);
+extern void mm_arena_reset(mm_arena_t *arena);
+extern void mm_arena_destroy(mm_arena_t *arena);
+
+/* Number of size classes tracked by mm_get_stats. The class bounds are
+ * tuned from trace profiles (see size_class_spec.hpp); the last class
+ * also takes everything larger. */
+#define MM_NUM_SIZE_CLASSES 16
+
+/* Heap counters, maintained incrementally by the allocator. */
+typedef struct {
+  size_t bytes_in_use;    /* payload bytes in allocated blocks */
+  size_t bytes_free;      /* payload bytes in free blocks */
+  size_t bytes_cached;    /* payload bytes of freed blocks held in fast bins */
+  size_t free_blocks[MM_NUM_SIZE_CLASSES]; /* free blocks per size class */
+  size_t bytes_fresh;     /* untouched bytes reserved at the top of the heap */
+  size_t heap_size;       /* current heap size in bytes */
+  size_t peak_heap_size;  /* largest heap size seen since mm_init */
+  size_t sbrk_calls;      /* number of times the heap was grown */
+  size_t splits;          /* free blocks split to serve a request */
+  size_t coalesces;       /* neighbouring free blocks merged */
+  size_t policy_switches; /* policy changes made by the adaptive mode */
+} mm_stats_t;
+
+/* Copy the current heap counters into stats. Runs in constant time. */
+extern void mm_get_stats(mm_stats_t *stats);
+
+/* Values of the "fit_policy" knob. */
+#define MM_FIT_FIRST 0  /* take the first free block that is large enough */
+#define MM_FIT_BEST  1  /* take the smallest free block that is large enough */
+
+/* Read and/or set an allocator knob at runtime, mallctl-style: the
+ * current value is stored in *oldp and then replaced by *newp, either of
+ * which may be NULL. Knobs: "alignment" (read-only), "split_threshold",
+ * "grow_chunk", "fastbin_max", "trim_threshold", "fit_policy",
+ * "adaptive" (1 lets the allocator drive fit_policy and fastbin_max
+ * from the observed workload; setting either of those by hand, or
+ * adaptive back to 0, ends it and restores the values they had before)
+ * and "policy" (read-only: the variant the adaptive mode is using).
+ * Returns 0 on success, -1 on an unknown name or a rejected value. */
+extern int mm_ctl(const char *name, size_t *oldp, const size_t *newp);
+
+/* One block as seen by mm_heap_walk. */
+typedef struct {
+  void *payload;    /* first payload byte */
+  size_t size;      /* payload bytes, including alignment padding */
+  size_t overhead;  /* bookkeeping bytes in front of the payload */
+  int allocated;    /* nonzero if the block is in use or in a fast bin */
+} mm_block_t;
+
+typedef void (*mm_walk_fn)(const mm_block_t *block, void *arg);
+
+/* Call fn once for every block in the heap, in address order. */
+extern void mm_heap_walk(mm_walk_fn fn, void *arg);
+
+#ifdef MM_INSTRUMENT
+/* Number of buckets in each search-length histogram. Bucket 0 counts
+ * searches that visited no blocks, bucket b > 0 those that visited
+ * [2^(b-1), 2^b) blocks; the last bucket also takes longer searches. */
+#define MM_HIST_BUCKETS 20
+
+/* Per-call histograms of hot-path work, collected since mm_init. */
+typedef struct {
+  size_t search_len[MM_HIST_BUCKETS]; /* free blocks visited per search */
+  size_t split[2];                    /* mallocs without / with a split */
+  size_t merges[3];                   /* neighbours merged per coalesce */
+} mm_instr_t;
+
+/* Copy the hot-path histograms into instr. */
+extern void mm_get_instr(mm_instr_t *instr);
+#endif
+
+/* INLINE FAST PATH
+ *
+ * Where the size passed to mm_malloc is a compile-time constant, the
+ * wrapper below computes its fast bin at compile time and pops a cached
+ * block inline, calling the out-of-line mm_malloc only when that bin is
+ * empty (or the size is too large for a fast bin). Fast bins hold blocks
+ * only while mm_ctl("fastbin_max") covers their size. Define
+ * MM_NO_INLINE to always call mm_malloc.
+ *
+ * Like the rest of mm, the inline pop takes no lock: it updates the
+ * global mm_fastbins directly, so it is only safe in a single-threaded
+ * program or under the same lock the caller holds around mm_malloc.
+ * The macro is defined after the mm_malloc declaration above, and the
+ * whole header sits under MM_H, so including it again leaves the
+ * prototype untouched.
+ */
+#define MM_ALIGNMENT 16       /* ALIGNMENT in mm.c */
+#define MM_HEADER_SIZE 16     /* bytes of BlockInfo in front of a payload */
+#define MM_FASTBIN_LIMIT 512  /* largest payload a fast bin can hold */
+#define MM_NUM_FASTBINS (MM_FASTBIN_LIMIT / MM_ALIGNMENT + 1)
+
+/* Fast-bin state, internal to mm but shared with the inline path. */
+typedef struct {
+  void *bins[MM_NUM_FASTBINS]; /* cached blocks, linked through the payload */
+  size_t bytes_cached;         /* payload bytes held in the bins */
+} mm_fastbins_t;
+
+extern mm_fastbins_t mm_fastbins;
+
+#if defined(__GNUC__) && !defined(MM_NO_INLINE)
+static inline __attribute__((always_inline)) void *mm_malloc_fast(size_t size) {
+  size_t reqSize = MM_ALIGNMENT * ((size + MM_ALIGNMENT - 1) / MM_ALIGNMENT);
+  char *block;
+  void *payload;
+
+  if (size != 0 && reqSize <= MM_FASTBIN_LIMIT &&
+      (block = (char *)mm_fastbins.bins[reqSize / MM_ALIGNMENT]) != NULL) {
+    /* Pop the cached block */
+    payload = block + MM_HEADER_SIZE;
+    mm_fastbins.bins[reqSize / MM_ALIGNMENT] = *(void **)payload;
+    mm_fastbins.bytes_cached -= reqSize;
+    return payload;
+  }
+
+  return (mm_malloc)(size);
+}
+
+#define mm_malloc(size) \
+  (__builtin_constant_p(size) ? mm_malloc_fast(size) : (mm_malloc)(size))
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MM_H */
@@ -0,0 +1,114 @@
+/*
+ * mm_allocator.hpp - C++ allocator adapters over mm_malloc/mm_free
+ *
+ * mm::memory_resource plugs the mm heap into std::pmr containers and
+ * mm::allocator<T> into ordinary STL containers, without replacing the
+ * process-wide malloc. Over-aligned requests go through mm_memalign and
+ * sizes are passed back on deallocation through mm_free_sized.
+ */
+#ifndef MM_ALLOCATOR_HPP
+#define MM_ALLOCATOR_HPP
+
+#include <cstddef>
+#include <limits>
+#include <memory_resource>
+#include <new>
+
+#include "mm.h"
+
+namespace mm {
+
+/* Alignment every mm_malloc block already has. */
+constexpr std::size_t kMallocAlign = 16;
+
+/* Allocate bytes aligned to align from the mm heap, or throw bad_alloc. */
+inline void *allocate_bytes(std::size_t bytes, std::size_t align) {
+    void *p;
+
+    if (bytes == 0)
+        bytes = 1; /* a zero-size request still needs a unique pointer */
+    if (align <= kMallocAlign)
+        p = mm_malloc(bytes);
+    else
+        p = mm_memalign(align, bytes);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+/* Give back memory from allocate_bytes. */
+inline void deallocate_bytes(void *p, std::size_t bytes, std::size_t align) {
+    if (align <= kMallocAlign)
+        mm_free_sized(p, bytes ? bytes : 1);
+    else
+        mm_free(p);
+}
+
+/*
+ * memory_resource - std::pmr resource backed by the mm heap. All
+ * instances share the one heap, so any two compare equal.
+ */
+class memory_resource : public std::pmr::memory_resource {
+private:
+    void *do_allocate(std::size_t bytes, std::size_t align) override {
+        return allocate_bytes(bytes, align);
+    }
+
+    void do_deallocate(void *p, std::size_t bytes,
+                       std::size_t align) override {
+        deallocate_bytes(p, bytes, align);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other)
+        const noexcept override {
+        return dynamic_cast<const memory_resource *>(&other) != nullptr;
+    }
+};
+
+/* The process-wide mm resource. */
+inline memory_resource *get_memory_resource() {
+    static memory_resource resource;
+    return &resource;
+}
+
+/*
+ * allocator<T> - stateless standard allocator over the mm heap.
+ */
+template <typename T>
+class allocator {
+public:
+    using value_type = T;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using propagate_on_container_move_assignment = std::true_type;
+    using is_always_equal = std::true_type;
+
+    allocator() noexcept = default;
+
+    template <typename U>
+    allocator(const allocator<U> &) noexcept {}
+
+    T *allocate(std::size_t n) {
+        if (n > std::numeric_limits<std::size_t>::max() / sizeof(T))
+            throw std::bad_array_new_length();
+        return static_cast<T *>(allocate_bytes(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *p, std::size_t n) noexcept {
+        deallocate_bytes(p, n * sizeof(T), alignof(T));
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const allocator<T> &, const allocator<U> &) noexcept {
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const allocator<T> &, const allocator<U> &) noexcept {
+    return false;
+}
+
+} // namespace mm
+
+#endif /* MM_ALLOCATOR_HPP */
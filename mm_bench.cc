@@ -0,0 +1,215 @@
+/*
+ * mm_bench.cc - compares STL container workloads on the mm heap against
+ *     the default allocator
+ *
+ * Each workload runs once through the standard allocator or the default
+ * std::pmr resource, and once through mm::allocator<T> or
+ * mm::memory_resource. The mm heap is reset before every run. The fixed
+ * workload also runs on mm::ObjectPool slots, and the arena
+ * workload compares releasing objects with one mm_free each against one
+ * mm_arena_reset.
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory_resource>
+#include <vector>
+
+#include "mm_allocator.hpp"
+#include "mm_pool.hpp"
+#include "memlib.h"
+
+/* Number of times each workload is repeated per measurement */
+#define REPS 5
+
+/* Elements per workload; sized to stay inside the MAX_HEAP of memlib */
+#define VECTOR_ELEMS 200000
+#define MAP_ELEMS    50000
+#define FIXED_ELEMS  1000000
+
+/* Objects held at once by the fixed-size workload */
+#define FIXED_BATCH  64
+
+/* Objects allocated, then released all together, per arena round */
+#define ARENA_ELEMS  50000
+#define ARENA_ROUNDS 20
+
+/* Reset the simulated heap and the mm package between runs */
+static void reset_mm() {
+    mem_reset_brk();
+    if (mm_init() < 0) {
+        std::printf("mm_init failed\n");
+        std::exit(1);
+    }
+}
+
+/* Grow a fresh vector element by element, REPS times */
+template <typename Vector, typename... Args>
+static void vector_workload(Args &&...args) {
+    for (int r = 0; r < REPS; r++) {
+        Vector v(args...);
+        for (long i = 0; i < VECTOR_ELEMS; i++)
+            v.push_back(i);
+    }
+}
+
+/* Fill a map, erase every other key and refill, REPS times */
+template <typename Map, typename... Args>
+static void map_workload(Args &&...args) {
+    for (int r = 0; r < REPS; r++) {
+        Map m(args...);
+        for (long i = 0; i < MAP_ELEMS; i++)
+            m[i * 7919 % MAP_ELEMS] = i;
+        for (long i = 0; i < MAP_ELEMS; i += 2)
+            m.erase(i);
+        for (long i = 0; i < MAP_ELEMS; i += 2)
+            m[i] = i;
+    }
+}
+
+/* Allocate and free 32-byte objects in batches. The constant size lets
+ * mm.h pop the fast bin inline; (mm_malloc) forces the out-of-line call. */
+template <bool Inline>
+static void fixed_workload() {
+    void *batch[FIXED_BATCH];
+
+    for (int r = 0; r < REPS; r++) {
+        for (long i = 0; i < FIXED_ELEMS; i += FIXED_BATCH) {
+            for (int j = 0; j < FIXED_BATCH; j++)
+                batch[j] = Inline ? mm_malloc(32) : (mm_malloc)(32);
+            for (int j = 0; j < FIXED_BATCH; j++)
+                mm_free(batch[j]);
+        }
+    }
+}
+
+/* A 32-byte object for the pool workload */
+struct Node {
+    explicit Node(long k) : key(k) {}
+    long key;
+    long pad[3];
+};
+
+/* The fixed-size workload on Nodes from an mm::ObjectPool; with
+ * Align = mm::kCacheLine each node gets a cache line of its own. */
+template <std::size_t Align>
+static void pool_workload() {
+    Node *batch[FIXED_BATCH];
+
+    for (int r = 0; r < REPS; r++) {
+        mm::ObjectPool<Node, Align> pool;
+        for (long i = 0; i < FIXED_ELEMS; i += FIXED_BATCH) {
+            for (int j = 0; j < FIXED_BATCH; j++)
+                batch[j] = pool.construct(i + j);
+            for (int j = 0; j < FIXED_BATCH; j++)
+                pool.destroy(batch[j]);
+        }
+    }
+}
+
+/* Allocate ARENA_ELEMS 32-byte objects and release them all together,
+ * ARENA_ROUNDS times: one mm_free per object, or one mm_arena_reset per
+ * round in an arena that is destroyed at the end. */
+template <bool Arena>
+static void arena_workload() {
+    static void *objs[ARENA_ELEMS];
+
+    for (int r = 0; r < REPS; r++) {
+        mm_arena_t *arena = Arena ? mm_arena_create() : nullptr;
+        if (Arena && arena == nullptr) {
+            std::printf("mm_arena_create failed\n");
+            std::exit(1);
+        }
+        for (int round = 0; round < ARENA_ROUNDS; round++) {
+            for (long i = 0; i < ARENA_ELEMS; i++) {
+                objs[i] = Arena ? mm_arena_malloc(arena, 32)
+                                : (mm_malloc)(32);
+                if (objs[i] == nullptr) {
+                    std::printf("out of memory\n");
+                    std::exit(1);
+                }
+            }
+            if (Arena) {
+                mm_arena_reset(arena);
+            } else {
+                for (long i = 0; i < ARENA_ELEMS; i++)
+                    mm_free(objs[i]);
+            }
+        }
+        if (Arena)
+            mm_arena_destroy(arena);
+    }
+}
+
+/* Time f and print one result line */
+template <typename F>
+static void run(const char *name, const char *alloc, F f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    std::chrono::duration<double> secs =
+        std::chrono::steady_clock::now() - start;
+    std::printf("%-8s%-12s%10.6f\n", name, alloc, secs.count());
+}
+
+int main() {
+    mem_init();
+
+    std::pmr::memory_resource *mm_resource = mm::get_memory_resource();
+
+    std::printf("%-8s%-12s%10s\n", "test", "allocator", "secs");
+
+    run("vector", "std", [] {
+        vector_workload<std::vector<long>>();
+    });
+    reset_mm();
+    run("vector", "mm", [] {
+        vector_workload<std::vector<long, mm::allocator<long>>>();
+    });
+    run("vector", "pmr-default", [] {
+        vector_workload<std::pmr::vector<long>>(
+            std::pmr::get_default_resource());
+    });
+    reset_mm();
+    run("vector", "pmr-mm", [&] {
+        vector_workload<std::pmr::vector<long>>(mm_resource);
+    });
+
+    run("map", "std", [] {
+        map_workload<std::map<long, long>>();
+    });
+    reset_mm();
+    run("map", "mm", [] {
+        map_workload<std::map<long, long, std::less<long>,
+                              mm::allocator<std::pair<const long, long>>>>();
+    });
+    run("map", "pmr-default", [] {
+        map_workload<std::pmr::map<long, long>>(
+            std::pmr::get_default_resource());
+    });
+    reset_mm();
+    run("map", "pmr-mm", [&] {
+        map_workload<std::pmr::map<long, long>>(mm_resource);
+    });
+
+    size_t fastbin_max = 64;
+    mm_ctl("fastbin_max", nullptr, &fastbin_max);
+    reset_mm();
+    run("fixed", "mm-call", [] { fixed_workload<false>(); });
+    reset_mm();
+    run("fixed", "mm-inline", [] { fixed_workload<true>(); });
+    reset_mm();
+    run("fixed", "pool", [] { pool_workload<alignof(Node)>(); });
+    reset_mm();
+    run("fixed", "pool-line", [] { pool_workload<mm::kCacheLine>(); });
+
+    fastbin_max = 0;
+    mm_ctl("fastbin_max", nullptr, &fastbin_max);
+    reset_mm();
+    run("arena", "mm-free", [] { arena_workload<false>(); });
+    reset_mm();
+    run("arena", "mm-arena", [] { arena_workload<true>(); });
+
+    mem_deinit();
+    return 0;
+}
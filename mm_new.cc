@@ -0,0 +1,149 @@
+/*
+ * mm_new.cc - replaces the global operator new/delete with the mm heap
+ *
+ * Link mm_new.o, mm.o and memlib.o into a C++ program to serve every
+ * new-expression from mm. The simulated heap is brought up on the first
+ * allocation. Sized deletes go through mm_free_sized and over-aligned
+ * news through mm_memalign. mm is not thread-safe, so neither is this.
+ */
+#include <cstddef>
+#include <new>
+
+#include "mm.h"
+#include "memlib.h"
+
+namespace {
+
+/* Alignment every mm_malloc block already has */
+constexpr std::size_t kMallocAlign = 16;
+
+/* Bring up memlib and mm before the first allocation */
+void ensure_init() {
+    static bool initialized = false;
+
+    if (!initialized) {
+        initialized = true;
+        mem_init();
+        mm_init();
+    }
+}
+
+/* One allocation attempt; nullptr on failure */
+void *try_alloc(std::size_t size, std::size_t align) {
+    ensure_init();
+    if (size == 0)
+        size = 1; /* every new-expression yields a unique pointer */
+    if (align <= kMallocAlign)
+        return mm_malloc(size);
+    return mm_memalign(align, size);
+}
+
+/* Allocate as the throwing forms must: retry through the new_handler
+ * and throw bad_alloc once there is none. mm returns NULL when memlib's
+ * heap is used up, so a handler can free memory and let the retry
+ * succeed. */
+void *alloc(std::size_t size, std::size_t align) {
+    for (;;) {
+        void *p = try_alloc(size, align);
+        if (p)
+            return p;
+
+        std::new_handler handler = std::get_new_handler();
+        if (handler == nullptr)
+            throw std::bad_alloc();
+        handler();
+    }
+}
+
+/* Allocate as the nothrow forms must */
+void *alloc_nothrow(std::size_t size, std::size_t align) noexcept {
+    try {
+        return alloc(size, align);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void dealloc(void *p) noexcept {
+    if (p)
+        mm_free(p);
+}
+
+void dealloc_sized(void *p, std::size_t size) noexcept {
+    if (p)
+        mm_free_sized(p, size ? size : 1);
+}
+
+} // namespace
+
+/* Plain forms */
+void *operator new(std::size_t size) {
+    return alloc(size, kMallocAlign);
+}
+void *operator new[](std::size_t size) {
+    return alloc(size, kMallocAlign);
+}
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+    return alloc_nothrow(size, kMallocAlign);
+}
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+    return alloc_nothrow(size, kMallocAlign);
+}
+
+void operator delete(void *p) noexcept {
+    dealloc(p);
+}
+void operator delete[](void *p) noexcept {
+    dealloc(p);
+}
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+    dealloc(p);
+}
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+    dealloc(p);
+}
+void operator delete(void *p, std::size_t size) noexcept {
+    dealloc_sized(p, size);
+}
+void operator delete[](void *p, std::size_t size) noexcept {
+    dealloc_sized(p, size);
+}
+
+/* Aligned forms */
+void *operator new(std::size_t size, std::align_val_t align) {
+    return alloc(size, static_cast<std::size_t>(align));
+}
+void *operator new[](std::size_t size, std::align_val_t align) {
+    return alloc(size, static_cast<std::size_t>(align));
+}
+void *operator new(std::size_t size, std::align_val_t align,
+                   const std::nothrow_t &) noexcept {
+    return alloc_nothrow(size, static_cast<std::size_t>(align));
+}
+void *operator new[](std::size_t size, std::align_val_t align,
+                     const std::nothrow_t &) noexcept {
+    return alloc_nothrow(size, static_cast<std::size_t>(align));
+}
+
+/* The block mm_memalign hands back holds at least size bytes after the
+ * aligned payload, so sized aligned deletes can take the sized path too */
+void operator delete(void *p, std::align_val_t) noexcept {
+    dealloc(p);
+}
+void operator delete[](void *p, std::align_val_t) noexcept {
+    dealloc(p);
+}
+void operator delete(void *p, std::size_t size, std::align_val_t) noexcept {
+    dealloc_sized(p, size);
+}
+void operator delete[](void *p, std::size_t size, std::align_val_t) noexcept {
+    dealloc_sized(p, size);
+}
+void operator delete(void *p, std::align_val_t,
+                     const std::nothrow_t &) noexcept {
+    dealloc(p);
+}
+void operator delete[](void *p, std::align_val_t,
+                       const std::nothrow_t &) noexcept {
+    dealloc(p);
+}
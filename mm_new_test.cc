@@ -0,0 +1,128 @@
+/*
+ * mm_new_test.cc - runs every operator new/delete form through mm_new.o
+ *
+ * Each form must return memory from the simulated heap with the right
+ * alignment, and the heap must be back to where it started once every
+ * object is deleted. The throwing forms must go through the new_handler
+ * and then throw bad_alloc, and the nothrow forms return nullptr, once
+ * memlib's heap is used up.
+ */
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <new>
+
+#include "mm.h"
+#include "memlib.h"
+
+/* Bytes held back for the new_handler to release */
+#define RESERVE_BYTES (12 * (1 << 20))
+
+static int failures = 0;
+
+#define CHECK(cond)                                                      \
+    do {                                                                 \
+        if (!(cond)) {                                                   \
+            std::printf("mm_new_test: %s:%d: %s\n", __FILE__, __LINE__,  \
+                        #cond);                                          \
+            failures++;                                                  \
+        }                                                                \
+    } while (0)
+
+/* A type whose alignment needs the aligned forms */
+struct alignas(64) Line {
+    char bytes[64];
+};
+
+static bool in_heap(const void *p, std::size_t align) {
+    const char *c = static_cast<const char *>(p);
+    return c >= static_cast<char *>(mem_heap_lo()) &&
+           c <= static_cast<char *>(mem_heap_hi()) &&
+           reinterpret_cast<std::uintptr_t>(p) % align == 0;
+}
+
+static std::size_t bytes_in_use() {
+    mm_stats_t stats;
+    mm_get_stats(&stats);
+    return stats.bytes_in_use;
+}
+
+static char *reserve;
+static int handler_calls = 0;
+
+/* Give the reserve back and step aside, so the retry succeeds */
+static void release_reserve() {
+    handler_calls++;
+    ::operator delete(reserve, RESERVE_BYTES);
+    reserve = nullptr;
+    std::set_new_handler(nullptr);
+}
+
+int main() {
+    /* The first new brings up memlib and mm */
+    int *first = new int(1);
+    CHECK(in_heap(first, alignof(int)));
+    delete first;
+
+    std::size_t base = bytes_in_use();
+
+    /* Plain and array forms, sized and unsized deletes */
+    long *one = new long(7);
+    long *many = new long[100];
+    void *raw = ::operator new(200);
+    void *raw_array = ::operator new[](300);
+    CHECK(in_heap(one, 16) && in_heap(many, 16));
+    CHECK(in_heap(raw, 16) && in_heap(raw_array, 16));
+    CHECK(mm_usable_size(raw) >= 200);
+    delete one;
+    delete[] many;
+    ::operator delete(raw, 200);
+    ::operator delete[](raw_array, 300);
+
+    /* nothrow forms */
+    void *nt = ::operator new(64, std::nothrow);
+    void *nt_array = ::operator new[](64, std::nothrow);
+    CHECK(nt && in_heap(nt, 16) && nt_array && in_heap(nt_array, 16));
+    ::operator delete(nt, std::nothrow);
+    ::operator delete[](nt_array, std::nothrow);
+
+    /* Aligned forms, sized and unsized */
+    Line *line = new Line;
+    Line *lines = new Line[10];
+    void *page = ::operator new(100, std::align_val_t(4096));
+    void *page_nt = ::operator new(100, std::align_val_t(4096), std::nothrow);
+    CHECK(in_heap(line, 64) && in_heap(lines, 64));
+    CHECK(in_heap(page, 4096) && page_nt && in_heap(page_nt, 4096));
+    delete line;
+    delete[] lines;
+    ::operator delete(page, 100, std::align_val_t(4096));
+    ::operator delete(page_nt, std::align_val_t(4096), std::nothrow);
+
+    CHECK(bytes_in_use() == base);
+
+    /* Out of memory: the handler frees the reserve and the retry fits */
+    reserve = static_cast<char *>(::operator new(RESERVE_BYTES));
+    std::set_new_handler(release_reserve);
+    void *big = ::operator new(RESERVE_BYTES);
+    CHECK(handler_calls == 1 && in_heap(big, 16));
+
+    /* ... and with no handler left the throwing form throws */
+    bool threw = false;
+    try {
+        ::operator new(RESERVE_BYTES);
+    } catch (const std::bad_alloc &) {
+        threw = true;
+    }
+    CHECK(threw);
+    CHECK(::operator new(RESERVE_BYTES, std::nothrow) == nullptr);
+    ::operator delete(big, RESERVE_BYTES);
+
+    CHECK(bytes_in_use() == base);
+
+    if (failures) {
+        std::printf("mm_new_test: %d check(s) failed\n", failures);
+        return 1;
+    }
+    std::printf("mm_new_test: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,137 @@
+/*
+ * mm_pool.hpp - typed fixed-size object pools on top of mm_malloc
+ *
+ * An mm::ObjectPool<T> takes slabs of many T-sized slots from mm_malloc
+ * and hands the slots out through an intrusive free list, so allocating
+ * and freeing a node costs a couple of pointer moves instead of a free
+ * list search, a split and a coalesce in mm.c.
+ */
+#ifndef MM_POOL_HPP
+#define MM_POOL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+#include "mm.h"
+
+namespace mm {
+
+/* Size of a cache line, for pools whose objects must not share one. */
+constexpr std::size_t kCacheLine = 64;
+
+/*
+ * ObjectPool<T, Align> - slots of sizeof(T) bytes aligned to Align (at
+ * least alignof(T); pass kCacheLine to give each object its own lines).
+ * Slabs of slots_per_slab slots are taken from mm_malloc on demand and
+ * only returned to mm when the pool is destroyed, so every object must
+ * have been destroyed or deallocated by then.
+ */
+template <typename T, std::size_t Align = alignof(T)>
+class ObjectPool {
+    static_assert((Align & (Align - 1)) == 0, "Align must be a power of two");
+    static_assert(Align >= alignof(T), "Align must satisfy alignof(T)");
+
+public:
+    explicit ObjectPool(std::size_t slots_per_slab = 256)
+        : slots_per_slab_(slots_per_slab ? slots_per_slab : 1) {}
+
+    ObjectPool(const ObjectPool &) = delete;
+    ObjectPool &operator=(const ObjectPool &) = delete;
+
+    ~ObjectPool() {
+        while (slabs_) {
+            Slab *next = slabs_->next;
+            mm_free(slabs_);
+            slabs_ = next;
+        }
+    }
+
+    /* Return uninitialized storage for one T, or nullptr if mm is out of
+     * memory. */
+    void *allocate() {
+        if (free_ == nullptr && !grow())
+            return nullptr;
+
+        FreeSlot *slot = free_;
+        free_ = slot->next;
+        return slot;
+    }
+
+    /* Give back storage obtained from allocate(). */
+    void deallocate(void *p) {
+        FreeSlot *slot = static_cast<FreeSlot *>(p);
+        slot->next = free_;
+        free_ = slot;
+    }
+
+    /* Allocate a slot and construct a T in it. */
+    template <typename... Args>
+    T *construct(Args &&...args) {
+        void *p = allocate();
+        if (p == nullptr)
+            throw std::bad_alloc();
+        try {
+            return ::new (p) T(std::forward<Args>(args)...);
+        } catch (...) {
+            deallocate(p);
+            throw;
+        }
+    }
+
+    /* Destroy a T made by construct() and give back its slot. */
+    void destroy(T *obj) {
+        if (obj == nullptr)
+            return;
+        obj->~T();
+        deallocate(obj);
+    }
+
+private:
+    struct FreeSlot {
+        FreeSlot *next;
+    };
+
+    struct Slab {
+        Slab *next;
+    };
+
+    /* Every slot holds a T or, while free, the free list link. */
+    static constexpr std::size_t kSlotAlign =
+        Align > alignof(FreeSlot) ? Align : alignof(FreeSlot);
+    static constexpr std::size_t kSlotSize =
+        ((sizeof(T) > sizeof(FreeSlot) ? sizeof(T) : sizeof(FreeSlot)) +
+         kSlotAlign - 1) / kSlotAlign * kSlotAlign;
+
+    /* Take a new slab from mm and thread its slots onto the free list. */
+    bool grow() {
+        /* mm_malloc only guarantees 16-byte alignment, so leave room to
+         * push the first slot up to kSlotAlign. */
+        std::size_t bytes = sizeof(Slab) + kSlotAlign - 1 +
+                            slots_per_slab_ * kSlotSize;
+        Slab *slab = static_cast<Slab *>(mm_malloc(bytes));
+        if (slab == nullptr)
+            return false;
+        slab->next = slabs_;
+        slabs_ = slab;
+
+        std::uintptr_t first = reinterpret_cast<std::uintptr_t>(slab + 1);
+        first = (first + kSlotAlign - 1) & ~(std::uintptr_t)(kSlotAlign - 1);
+        char *slot = reinterpret_cast<char *>(first) +
+                     (slots_per_slab_ - 1) * kSlotSize;
+
+        /* Thread back to front so slots are handed out in address order */
+        for (std::size_t i = 0; i < slots_per_slab_; i++, slot -= kSlotSize)
+            deallocate(slot);
+        return true;
+    }
+
+    std::size_t slots_per_slab_;
+    Slab *slabs_ = nullptr;     /* every slab taken from mm */
+    FreeSlot *free_ = nullptr;  /* slots ready to hand out */
+};
+
+} // namespace mm
+
+#endif /* MM_POOL_HPP */
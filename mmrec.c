@@ -0,0 +1,665 @@
+/*
+ * mmrec.c - records a program's allocations as a .rep trace, built as
+ *     libmmrec.so
+ *
+ *     LD_PRELOAD=./libmmrec.so MMREC_FILE=prog.rep <program>
+ *
+ * malloc, calloc, realloc, free and the aligned allocators are passed on
+ * to the next definition (normally libc's) and logged as a, c, r, f and
+ * m ops, in the version 2 format of trace.h. Ops from any thread but the
+ * first to allocate carry its "t<tid>", and with MMREC_TIME=1 every op
+ * carries "@<ns>", the time since recording started.
+ * Each live block gets the lowest id not in use, so ids stay dense and
+ * num_ids is the peak number of live blocks. Blocks still live at exit
+ * are freed at the end of the trace to keep it balanced, like the traces
+ * in traces/. Every "%p" in MMREC_FILE is replaced by the process id; the
+ * default is mmrec.%p.rep. Programs that run others (the children inherit
+ * LD_PRELOAD) need the %p, or each process overwrites the same file.
+ * mdriver -f replays a recording, r ops included, through mm_realloc.
+ *
+ * Ops go through one buffer flushed with write(2), and the header, which
+ * is only known at exit, is written over a fixed-width placeholder. Every
+ * call holds one lock, so the order of the ops is the order in which the
+ * allocator saw them. Forked children do not record.
+ */
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+/* libmmrec.so is built with -fvisibility=hidden; only these are exported */
+#define EXPORT __attribute__((visibility("default")))
+
+/* Size of the output buffer, and the room one op can take in it. */
+#define OUT_SIZE (64 * 1024)
+#define OP_MAX 128
+
+/* First line of the header, and the width of each of its four numbers. */
+#define VERSION_LINE "#mmtrace 2\n"
+#define HEADER_WIDTH 20
+#define HEADER_SIZE (sizeof(VERSION_LINE) - 1 + 4 * (HEADER_WIDTH + 1))
+
+/* Bootstrap buffer for the allocations dlsym makes while the real
+ * functions are being looked up. */
+#define BOOTSTRAP_SIZE (16 * 1024)
+
+/* Initial number of slots in the pointer table, a power of two. */
+#define TABLE_INIT (1 << 16)
+
+/* The allocator functions being recorded. */
+static void* (*real_malloc)(size_t);
+static void* (*real_calloc)(size_t, size_t);
+static void* (*real_realloc)(void*, size_t);
+static void (*real_free)(void*);
+static int (*real_posix_memalign)(void**, size_t, size_t);
+static void* (*real_aligned_alloc)(size_t, size_t);
+static void* (*real_memalign)(size_t, size_t);
+
+static pthread_mutex_t rec_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Set while this thread is inside the recorder; nested allocations (from
+ * dlsym, or from libc itself) are passed through unrecorded. */
+static __thread int in_rec __attribute__((tls_model("initial-exec")));
+
+/* This thread's id in the trace plus one, or 0 until it first records. */
+static __thread int rec_tid __attribute__((tls_model("initial-exec")));
+
+static char bootstrap[BOOTSTRAP_SIZE] __attribute__((aligned(16)));
+static size_t bootstrap_used = 0;
+
+/* Recorder state, all under rec_lock. */
+static enum { REC_OFF, REC_ON, REC_DONE } state = REC_OFF;
+static int out_fd = -1;
+static char out[OUT_SIZE];
+static size_t out_len = 0;
+static pid_t rec_pid;
+static int num_tids = 0;
+static int rec_time = 0;            // MMREC_TIME is set
+static struct timespec rec_epoch;   // when recording started
+
+/* Live blocks: an open-addressing table from pointer to id and size. */
+typedef struct {
+  void* ptr;     // NULL for an empty slot
+  unsigned id;
+  size_t size;
+} Entry;
+
+static Entry* table = NULL;
+static size_t table_slots = 0;
+static size_t table_used = 0;
+
+/* Ids of freed blocks, handed out again lowest first. */
+static unsigned* free_ids = NULL;
+static size_t free_ids_len = 0;
+static size_t free_ids_cap = 0;
+
+/* Header counters. */
+static unsigned num_ids = 0;
+static size_t num_ops = 0;
+static size_t live_bytes = 0;
+static size_t peak_bytes = 0;
+
+static void* bootstrap_malloc(size_t size) {
+  size_t need = (size + 15) & ~(size_t)15;
+  size_t start = __atomic_fetch_add(&bootstrap_used, need, __ATOMIC_RELAXED);
+
+  if (start + need > BOOTSTRAP_SIZE) {
+    return NULL;
+  }
+  return bootstrap + start;
+}
+
+static int is_bootstrap(void* ptr) {
+  return (char*)ptr >= bootstrap && (char*)ptr < bootstrap + BOOTSTRAP_SIZE;
+}
+
+/* Look up the next definition of every recorded function. */
+static void resolve(void) {
+  in_rec = 1;
+  real_malloc = dlsym(RTLD_NEXT, "malloc");
+  real_calloc = dlsym(RTLD_NEXT, "calloc");
+  real_realloc = dlsym(RTLD_NEXT, "realloc");
+  real_free = dlsym(RTLD_NEXT, "free");
+  real_posix_memalign = dlsym(RTLD_NEXT, "posix_memalign");
+  real_aligned_alloc = dlsym(RTLD_NEXT, "aligned_alloc");
+  real_memalign = dlsym(RTLD_NEXT, "memalign");
+  in_rec = 0;
+}
+
+/* Memory for the recorder's own tables, straight from the kernel so that
+ * it never shows up in the trace. */
+static void* rec_alloc(size_t size) {
+  void* mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  return mem == MAP_FAILED ? NULL : mem;
+}
+
+// OUTPUT -----------------------------------------------------------
+
+static void flush_out(void) {
+  size_t done = 0;
+  ssize_t n;
+
+  while (done < out_len) {
+    n = write(out_fd, out + done, out_len - done);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    done += n;
+  }
+  out_len = 0;
+}
+
+/* Write value in decimal at p, right-aligned in width characters if width
+ * is nonzero. Returns the number of characters written. */
+static size_t put_num(char* p, size_t value, size_t width) {
+  char digits[HEADER_WIDTH];
+  size_t n = 0;
+  size_t len = 0;
+
+  do {
+    digits[n++] = '0' + value % 10;
+    value /= 10;
+  } while (value);
+
+  while (width > n) {
+    p[len++] = ' ';
+    width--;
+  }
+  while (n) {
+    p[len++] = digits[--n];
+  }
+  return len;
+}
+
+/* Append one op, prefixed with the thread and time if there are any;
+ * size is ignored for frees and align for all but memaligns. */
+static void put_op(char type, unsigned id, size_t align, size_t size) {
+  struct timespec now;
+  char* p;
+
+  if (out_len + OP_MAX > OUT_SIZE) {
+    flush_out();
+  }
+  if (rec_tid == 0) {
+    rec_tid = ++num_tids;
+  }
+
+  p = out + out_len;
+  if (rec_tid > 1) {
+    *p++ = 't';
+    p += put_num(p, rec_tid - 1, 0);
+    *p++ = ' ';
+  }
+  if (rec_time) {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    *p++ = '@';
+    p += put_num(p, (now.tv_sec - rec_epoch.tv_sec) * 1000000000L +
+                 now.tv_nsec - rec_epoch.tv_nsec, 0);
+    *p++ = ' ';
+  }
+  *p++ = type;
+  *p++ = ' ';
+  p += put_num(p, id, 0);
+  if (type == 'm') {
+    *p++ = ' ';
+    p += put_num(p, align, 0);
+  }
+  if (type != 'f') {
+    *p++ = ' ';
+    p += put_num(p, size, 0);
+  }
+  *p++ = '\n';
+
+  out_len = p - out;
+  num_ops++;
+}
+
+/* Format the header, fixed width so it can be written over the
+ * placeholder at exit. Returns its length. */
+static size_t put_header(char* p) {
+  size_t len = 0;
+  size_t fields[4];
+  int i;
+
+  fields[0] = peak_bytes;   // suggested heap size
+  fields[1] = num_ids;
+  fields[2] = num_ops;
+  fields[3] = 1;            // weight
+
+  memcpy(p, VERSION_LINE, sizeof(VERSION_LINE) - 1);
+  len = sizeof(VERSION_LINE) - 1;
+  for (i = 0; i < 4; i++) {
+    len += put_num(p + len, fields[i], HEADER_WIDTH);
+    p[len++] = '\n';
+  }
+  return len;
+}
+
+/* Hold the lock across fork so the child does not inherit it taken. */
+static void fork_prepare(void) {
+  pthread_mutex_lock(&rec_lock);
+}
+
+static void fork_release(void) {
+  pthread_mutex_unlock(&rec_lock);
+}
+
+/* Open the output file on the first recorded op. "%p" in MMREC_FILE is
+ * replaced by the process id. */
+static int start(void) {
+  const char* name;
+  char path[PATH_MAX];
+  size_t len = 0;
+
+  if (state != REC_OFF) {
+    return state == REC_ON && getpid() == rec_pid;
+  }
+
+  name = getenv("MMREC_FILE");
+  if (name == NULL) {
+    name = "mmrec.%p.rep";
+  }
+
+  for (; *name && len + HEADER_WIDTH < sizeof(path); name++) {
+    if (name[0] == '%' && name[1] == 'p') {
+      len += put_num(path + len, getpid(), 0);
+      name++;
+    } else {
+      path[len++] = *name;
+    }
+  }
+  path[len] = '\0';
+
+  out_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  table_slots = TABLE_INIT;
+  table = rec_alloc(table_slots * sizeof(Entry));
+  if (out_fd < 0 || table == NULL) {
+    state = REC_DONE;
+    return 0;
+  }
+
+  name = getenv("MMREC_TIME");
+  rec_time = name && *name && *name != '0';
+  clock_gettime(CLOCK_MONOTONIC, &rec_epoch);
+
+  // Placeholder header, rewritten at exit
+  out_len = put_header(out);
+  rec_pid = getpid();
+  pthread_atfork(fork_prepare, fork_release, fork_release);
+  state = REC_ON;
+  return 1;
+}
+
+// LIVE BLOCKS ------------------------------------------------------
+
+static size_t slot_of(void* ptr) {
+  uintptr_t h = (uintptr_t)ptr >> 4;
+
+  h ^= h >> 17;
+  h *= 0x9E3779B97F4A7C15ULL;
+  return (h >> 20) & (table_slots - 1);
+}
+
+static Entry* lookup(void* ptr) {
+  size_t i = slot_of(ptr);
+
+  while (table[i].ptr) {
+    if (table[i].ptr == ptr) {
+      return &table[i];
+    }
+    i = (i + 1) & (table_slots - 1);
+  }
+  return NULL;
+}
+
+static void insert(void* ptr, unsigned id, size_t size) {
+  size_t i = slot_of(ptr);
+
+  while (table[i].ptr) {
+    i = (i + 1) & (table_slots - 1);
+  }
+  table[i].ptr = ptr;
+  table[i].id = id;
+  table[i].size = size;
+  table_used++;
+}
+
+/* Double the table once it is half full. */
+static int grow_table(void) {
+  Entry* old = table;
+  size_t oldSlots = table_slots;
+  size_t i;
+
+  table = rec_alloc(2 * oldSlots * sizeof(Entry));
+  if (table == NULL) {
+    table = old;
+    return 0;
+  }
+  table_slots = 2 * oldSlots;
+  table_used = 0;
+  for (i = 0; i < oldSlots; i++) {
+    if (old[i].ptr) {
+      insert(old[i].ptr, old[i].id, old[i].size);
+    }
+  }
+  munmap(old, oldSlots * sizeof(Entry));
+  return 1;
+}
+
+/* Remove e, shifting later entries of its probe run back into the gap. */
+static void erase(Entry* e) {
+  size_t i = e - table;
+  size_t j = i;
+  size_t home;
+
+  for (;;) {
+    j = (j + 1) & (table_slots - 1);
+    if (table[j].ptr == NULL) {
+      break;
+    }
+    home = slot_of(table[j].ptr);
+    // Move j into the gap at i unless its home lies in (i, j]
+    if ((j > i && (home <= i || home > j)) ||
+        (j < i && (home <= i && home > j))) {
+      table[i] = table[j];
+      i = j;
+    }
+  }
+  table[i].ptr = NULL;
+  table_used--;
+}
+
+/* Push id onto the free ids, keeping the smallest on top. */
+static void release_id(unsigned id) {
+  size_t i;
+
+  if (free_ids_len == free_ids_cap) {
+    size_t cap = free_ids_cap ? 2 * free_ids_cap : 4096;
+    unsigned* ids = rec_alloc(cap * sizeof(unsigned));
+    if (ids == NULL) {
+      return;
+    }
+    if (free_ids) {
+      memcpy(ids, free_ids, free_ids_len * sizeof(unsigned));
+      munmap(free_ids, free_ids_cap * sizeof(unsigned));
+    }
+    free_ids = ids;
+    free_ids_cap = cap;
+  }
+
+  // Ids are mostly released in the order they were handed out, so an
+  // insertion from the top stays short
+  i = free_ids_len++;
+  while (i > 0 && free_ids[i - 1] < id) {
+    free_ids[i] = free_ids[i - 1];
+    i--;
+  }
+  free_ids[i] = id;
+}
+
+// RECORDING --------------------------------------------------------
+
+/* Record that ptr was allocated with size bytes, by an op of type 'a',
+ * 'c' or 'm' (aligned to align). */
+static void record_alloc(char type, void* ptr, size_t align, size_t size) {
+  unsigned id;
+
+  if (ptr == NULL || !start()) {
+    return;
+  }
+  if (2 * (table_used + 1) > table_slots && !grow_table()) {
+    return;
+  }
+
+  id = free_ids_len ? free_ids[--free_ids_len] : num_ids++;
+  insert(ptr, id, size);
+
+  // mm_malloc(0) returns NULL, which mdriver reports as a failure
+  put_op(type, id, align, size ? size : 1);
+
+  live_bytes += size;
+  if (live_bytes > peak_bytes) {
+    peak_bytes = live_bytes;
+  }
+}
+
+/* Record that ptr was freed. Blocks allocated before recording started
+ * are not in the table and are skipped. */
+static void record_free(void* ptr) {
+  Entry* e;
+
+  if (ptr == NULL || !start() || (e = lookup(ptr)) == NULL) {
+    return;
+  }
+
+  put_op('f', e->id, 0, 0);
+  live_bytes -= e->size;
+  release_id(e->id);
+  erase(e);
+}
+
+/* Record that ptr was resized to size bytes at newPtr. */
+static void record_realloc(void* ptr, void* newPtr, size_t size) {
+  Entry* e;
+  unsigned id;
+
+  if (!start()) {
+    return;
+  }
+  if ((e = lookup(ptr)) == NULL) {
+    // Not recorded: the block appears in the trace here
+    record_alloc('a', newPtr, 0, size);
+    return;
+  }
+
+  id = e->id;
+  live_bytes += size - e->size;
+  if (live_bytes > peak_bytes) {
+    peak_bytes = live_bytes;
+  }
+  erase(e);
+  insert(newPtr, id, size);
+  put_op('r', id, 0, size ? size : 1);
+}
+
+/* Take the lock for one recorded call. Returns 0 for a nested call,
+ * which is passed through unrecorded. */
+static int enter(void) {
+  if (in_rec) {
+    return 0;
+  }
+  pthread_mutex_lock(&rec_lock);
+  in_rec = 1;
+  return 1;
+}
+
+static void leave(void) {
+  in_rec = 0;
+  pthread_mutex_unlock(&rec_lock);
+}
+
+/* Start recording when the library is loaded at the latest, while the
+ * environment is still safe to read: a program's putenv can reallocate
+ * it, and so call back into the recorder, halfway through an update. */
+__attribute__((constructor)) static void begin(void) {
+  if (enter()) {
+    start();
+    leave();
+  }
+}
+
+/* Free every block still live, then write the real header. */
+__attribute__((destructor)) static void finish(void) {
+  size_t i;
+  char header[HEADER_SIZE];
+
+  pthread_mutex_lock(&rec_lock);
+  if (state == REC_ON && getpid() == rec_pid) {
+    for (i = 0; i < table_slots; i++) {
+      if (table[i].ptr) {
+        put_op('f', table[i].id, 0, 0);
+      }
+    }
+    flush_out();
+    pwrite(out_fd, header, put_header(header), 0);
+    close(out_fd);
+    state = REC_DONE;
+  }
+  pthread_mutex_unlock(&rec_lock);
+}
+
+// INTERPOSED FUNCTIONS ---------------------------------------------
+
+EXPORT void* malloc(size_t size) {
+  void* ptr;
+
+  if (real_malloc == NULL) {
+    if (in_rec) {
+      return bootstrap_malloc(size);
+    }
+    resolve();
+  }
+  if (!enter()) {
+    return real_malloc(size);
+  }
+
+  ptr = real_malloc(size);
+  record_alloc('a', ptr, 0, size);
+  leave();
+  return ptr;
+}
+
+EXPORT void* calloc(size_t nmemb, size_t size) {
+  void* ptr;
+
+  if (real_calloc == NULL) {
+    if (in_rec) {
+      // dlsym's calloc: the bootstrap buffer is zeroed already
+      return bootstrap_malloc(nmemb * size);
+    }
+    resolve();
+  }
+  if (!enter()) {
+    return real_calloc(nmemb, size);
+  }
+
+  ptr = real_calloc(nmemb, size);
+  record_alloc('c', ptr, 0, nmemb * size);
+  leave();
+  return ptr;
+}
+
+EXPORT void* realloc(void* ptr, size_t size) {
+  void* newPtr;
+
+  if (real_realloc == NULL) {
+    resolve();
+  }
+  if (is_bootstrap(ptr)) {
+    // Move the block out of the bootstrap buffer; it is never larger
+    // than what is left of the buffer
+    newPtr = malloc(size);
+    if (newPtr) {
+      size_t left = bootstrap + BOOTSTRAP_SIZE - (char*)ptr;
+      memcpy(newPtr, ptr, left < size ? left : size);
+    }
+    return newPtr;
+  }
+  if (!enter()) {
+    return real_realloc(ptr, size);
+  }
+
+  newPtr = real_realloc(ptr, size);
+  if (ptr == NULL) {
+    record_alloc('a', newPtr, 0, size);
+  } else if (size == 0) {
+    // libc's realloc(ptr, 0) frees ptr
+    record_free(ptr);
+    record_alloc('a', newPtr, 0, size);
+  } else if (newPtr) {
+    record_realloc(ptr, newPtr, size);
+  }
+  leave();
+  return newPtr;
+}
+
+EXPORT void free(void* ptr) {
+  if (ptr == NULL || is_bootstrap(ptr)) {
+    return;
+  }
+  if (real_free == NULL) {
+    resolve();
+  }
+  if (!enter()) {
+    real_free(ptr);
+    return;
+  }
+
+  // Drop ptr from the table before another thread can be handed it
+  record_free(ptr);
+  real_free(ptr);
+  leave();
+}
+
+EXPORT int posix_memalign(void** memptr, size_t align, size_t size) {
+  int ret;
+
+  if (real_posix_memalign == NULL) {
+    resolve();
+  }
+  if (!enter()) {
+    return real_posix_memalign(memptr, align, size);
+  }
+
+  ret = real_posix_memalign(memptr, align, size);
+  if (ret == 0) {
+    record_alloc('m', *memptr, align, size);
+  }
+  leave();
+  return ret;
+}
+
+EXPORT void* aligned_alloc(size_t align, size_t size) {
+  void* ptr;
+
+  if (real_aligned_alloc == NULL) {
+    resolve();
+  }
+  if (!enter()) {
+    return real_aligned_alloc(align, size);
+  }
+
+  ptr = real_aligned_alloc(align, size);
+  record_alloc('m', ptr, align, size);
+  leave();
+  return ptr;
+}
+
+EXPORT void* memalign(size_t align, size_t size) {
+  void* ptr;
+
+  if (real_memalign == NULL) {
+    resolve();
+  }
+  if (!enter()) {
+    return real_memalign(align, size);
+  }
+
+  ptr = real_memalign(align, size);
+  record_alloc('m', ptr, align, size);
+  leave();
+  return ptr;
+}
@@ -0,0 +1,30 @@
+/*
+ * size_class_spec.hpp - size-class bounds for size_classes.hpp
+ *
+ * Generated by "gen_size_classes -p" from 13 traces (60997 requests).
+ * Mean gap between a request and its class bound: 8.83% of the request.
+ */
+#ifndef MM_SIZE_CLASS_SPEC_HPP
+#define MM_SIZE_CLASS_SPEC_HPP
+
+#include <array>
+#include <cstddef>
+
+namespace mm {
+namespace size_classes {
+namespace spec {
+
+/* Largest payload of each class; the last class also takes everything larger */
+constexpr std::array<std::size_t, 16> kClassMax = {{
+    16, 64, 112, 128, 160, 512, 4096, 8192,
+    12608, 18368, 24976, 32768, 103296, 222080, 392064, 614784
+}};
+
+/* Objects of the largest size of a class that fit in its slab */
+constexpr std::size_t kSlabObjects = 64;
+
+} // namespace spec
+} // namespace size_classes
+} // namespace mm
+
+#endif /* MM_SIZE_CLASS_SPEC_HPP */
@@ -0,0 +1,95 @@
+/*
+ * size_classes.hpp - compile-time size-class tables
+ *
+ * The class boundaries come from the spec in size_class_spec.hpp (which
+ * "gen_size_classes -p" derives from trace profiles). Everything else,
+ * the class-index lookup table and the per-class slab sizes, is computed
+ * from it with constexpr functions. gen_size_classes prints the results
+ * as size_classes.h for the C build of mm.c; C++ code can use them
+ * directly.
+ */
+#ifndef MM_SIZE_CLASSES_HPP
+#define MM_SIZE_CLASSES_HPP
+
+#include <array>
+#include <cstddef>
+
+#include "mm.h"
+#include "size_class_spec.hpp"
+
+namespace mm {
+namespace size_classes {
+
+constexpr std::size_t kNumClasses = MM_NUM_SIZE_CLASSES;
+
+/* Sizes up to kLookupLimit are classified by a single table lookup */
+constexpr std::size_t kLookupLimit = 8192;
+constexpr std::size_t kLookupEntries = kLookupLimit / MM_ALIGNMENT + 1;
+
+/* Slabs are whole pages and hold at least kSlabObjects objects, but are
+ * never rounded beyond kMaxSlab unless one object needs it */
+constexpr std::size_t kPage = 4096;
+constexpr std::size_t kMaxSlab = 256 * 1024;
+
+static_assert(spec::kClassMax.size() == kNumClasses,
+              "size_class_spec.hpp must list MM_NUM_SIZE_CLASSES bounds");
+
+/* Check the spec: bounds ALIGNMENT-multiples, strictly increasing */
+constexpr bool spec_is_valid() {
+    for (std::size_t c = 0; c < kNumClasses; c++) {
+        if (spec::kClassMax[c] % MM_ALIGNMENT != 0)
+            return false;
+        if (c > 0 && spec::kClassMax[c] <= spec::kClassMax[c - 1])
+            return false;
+    }
+    return spec::kClassMax[0] >= MM_ALIGNMENT;
+}
+static_assert(spec_is_valid(), "size_class_spec.hpp bounds are malformed");
+
+/* Largest payload of class c; the last class also takes everything
+ * above its bound */
+constexpr std::size_t class_max(std::size_t c) {
+    return spec::kClassMax[c];
+}
+
+/* Class of an ALIGNMENT-rounded payload size */
+constexpr std::size_t class_of(std::size_t size) {
+    std::size_t c = 0;
+    while (c < kNumClasses - 1 && size > spec::kClassMax[c])
+        c++;
+    return c;
+}
+
+/* Class of every ALIGNMENT-rounded size up to kLookupLimit, indexed by
+ * size / MM_ALIGNMENT */
+constexpr std::array<unsigned char, kLookupEntries> make_lookup() {
+    std::array<unsigned char, kLookupEntries> table{};
+    for (std::size_t i = 0; i < kLookupEntries; i++)
+        table[i] = static_cast<unsigned char>(class_of(i * MM_ALIGNMENT));
+    return table;
+}
+
+/* Slab size for class c: kSlabObjects objects of the class's largest
+ * size plus their headers, in whole pages */
+constexpr std::size_t slab_size(std::size_t c) {
+    std::size_t object = class_max(c) + MM_HEADER_SIZE;
+    std::size_t bytes = object * spec::kSlabObjects;
+    if (bytes > kMaxSlab)
+        bytes = object > kMaxSlab ? object : kMaxSlab;
+    return (bytes + kPage - 1) / kPage * kPage;
+}
+
+constexpr std::array<std::size_t, kNumClasses> make_slabs() {
+    std::array<std::size_t, kNumClasses> slabs{};
+    for (std::size_t c = 0; c < kNumClasses; c++)
+        slabs[c] = slab_size(c);
+    return slabs;
+}
+
+constexpr std::array<unsigned char, kLookupEntries> kLookup = make_lookup();
+constexpr std::array<std::size_t, kNumClasses> kSlabSize = make_slabs();
+
+} // namespace size_classes
+} // namespace mm
+
+#endif /* MM_SIZE_CLASSES_HPP */
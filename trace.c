@@ -0,0 +1,989 @@
+/*
+ * trace.c - loads and writes allocation traces
+ *
+ * Text traces are parsed into a malloc'd op array. Binary traces are
+ * mapped read-only and their records used as the op array directly.
+ * Compressed traces are mapped and decoded into a malloc'd op array.
+ * Streams hand out a trace a window at a time, from two buffers that a
+ * reader thread fills in turn.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include "trace.h"
+#include "mm.h"
+
+#define MAXLINE 1024
+
+/* Version 1 records */
+typedef struct {
+    int type;
+    int index;
+    int size;
+    int hint;
+} traceop_v1_t;
+
+/* Version 2 header, and the size of the version 1 header, which stops
+ * before flags */
+typedef struct {
+    char magic[8];
+    int version;
+    int op_size;
+    int sugg_heapsize;
+    int num_ids;
+    int num_ops;
+    int weight;
+    int flags;
+    int num_threads;
+} trace_header_v2_t;
+
+#define TRACE_V1_HEADER_SIZE offsetof(trace_header_v2_t, flags)
+
+static void trace_error(const char *path, const char *msg) {
+    fprintf(stderr, "%s: %s\n", path, msg);
+    exit(1);
+}
+
+/* Whether align is one memalign can take: a power of two */
+#define VALID_ALIGN(align) ((align) > 0 && ((align) & ((align) - 1)) == 0)
+
+/*
+ * check_op - reject the trace at path, which has num_ids ids, if op
+ *     would take the driver outside its op table or block arrays: an
+ *     unknown type, an id outside the trace (or a batch running past its
+ *     last id), a negative size or thread, an empty batch or arena, or a
+ *     memalign to an alignment that is not a power of two
+ */
+static void check_op(const traceop_t *op, int num_ids, const char *path) {
+    long blocks = (op->type == BATCH) ? op->count : 1;
+
+    if ((unsigned)op->type > ARENA)
+        trace_error(path, "bogus op type in trace");
+    if (op->size < 0 || op->tid < 0)
+        trace_error(path, "negative size or thread in trace");
+    if ((op->type == BATCH && op->count <= 0) ||
+        (op->type == ARENA && (op->count <= 0 || op->size == 0)))
+        trace_error(path, "empty batch or arena in trace");
+    if (op->type == MEMALIGN && !VALID_ALIGN(op->align))
+        trace_error(path, "memalign alignment is not a power of two");
+    if (op->type != ARENA &&
+        (op->index < 0 || op->index + blocks > num_ids))
+        trace_error(path, "block id outside the trace's ids");
+}
+
+/*
+ * check_ops - check_op each of n ops
+ */
+static void check_ops(const traceop_t *ops, int n, int num_ids,
+                      const char *path) {
+    int i;
+
+    for (i = 0; i < n; i++)
+        check_op(&ops[i], num_ids, path);
+}
+
+/*
+ * alloc_blocks - allocate the arrays that track a trace's live blocks
+ */
+static void alloc_blocks(trace_t *trace) {
+    /* We'll keep an array of pointers to the allocated blocks here... */
+    if ((trace->blocks =
+         (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
+        trace_error("trace_load", "malloc failed for the block array");
+
+    /* ... along with the corresponding byte sizes of each block */
+    if ((trace->block_sizes =
+         (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
+        trace_error("trace_load", "malloc failed for the block size array");
+}
+
+/*
+ * note_op - fold op into the flags and thread count of trace
+ */
+static void note_op(trace_t *trace, const traceop_t *op) {
+    if (op->tid) {
+        trace->flags |= TRACE_TIDS;
+        if (op->tid >= trace->num_threads)
+            trace->num_threads = op->tid + 1;
+    }
+    if (op->time)
+        trace->flags |= TRACE_TIMES;
+}
+
+/*
+ * read_header - read the header of a .rep trace: an optional
+ *     "#mmtrace <version>" line, then four numbers
+ */
+static void read_header(trace_t *trace, FILE *tracefile, const char *path) {
+    char line[MAXLINE];
+    int c, version;
+
+    if ((c = getc(tracefile)) != EOF)
+        ungetc(c, tracefile);
+    if (c == '#' && fgets(line, MAXLINE, tracefile) &&
+        sscanf(line, "#mmtrace %d", &version) == 1 && version > 2)
+        trace_error(path, "trace is newer than this reader");
+
+    if (fscanf(tracefile, "%ld", &(trace->sugg_heapsize)) != 1 ||
+        fscanf(tracefile, "%d", &(trace->num_ids)) != 1 ||
+        fscanf(tracefile, "%d", &(trace->num_ops)) != 1 ||
+        fscanf(tracefile, "%d", &(trace->weight)) != 1)           /* not used */
+        trace_error(path, "malformed trace header");
+    trace->flags = 0;
+    trace->num_threads = 1;
+}
+
+/*
+ * field - parse the next number of an op line at *p
+ */
+static long field(char **p, const char *path) {
+    char *end;
+    long value = strtol(*p, &end, 10);
+
+    if (end == *p)
+        trace_error(path, "missing number in trace op");
+    *p = end;
+    return value;
+}
+
+/*
+ * parse_op - parse the next op of a .rep trace with num_ids ids into op,
+ *     and check it. Returns 0 at the end of the trace. Blank lines and
+ *     comments are skipped. See trace.h for the ops; hinted allocs
+ *     "h <id> <size> <s|l>" replay through mm_malloc_hint as short-lived
+ *     (s) or long-lived (l) objects.
+ */
+static int parse_op(FILE *tracefile, traceop_t *op, int num_ids,
+                    const char *path) {
+    char line[MAXLINE];
+    char msg[MAXLINE];
+    char *p;
+
+    do {
+        if (fgets(line, MAXLINE, tracefile) == NULL)
+            return 0;
+        p = line + strspn(line, " \t\r\n");
+    } while (*p == '\0' || *p == '#');
+
+    memset(op, 0, sizeof(*op));
+
+    /* The thread and time prefixes of version 2 */
+    if (*p == 't') {
+        p++;
+        op->tid = field(&p, path);
+        p += strspn(p, " \t");
+    }
+    if (*p == '@') {
+        p++;
+        op->time = field(&p, path);
+        p += strspn(p, " \t");
+    }
+
+    switch (*p++) {
+    case 'a':
+        op->type = ALLOC;
+        op->index = field(&p, path);
+        op->size = field(&p, path);
+        break;
+    case 'h':
+        op->type = ALLOC;
+        op->index = field(&p, path);
+        op->size = field(&p, path);
+        p += strspn(p, " \t");
+        op->hint = (*p == 's') ? MM_SHORT_LIVED : MM_LONG_LIVED;
+        break;
+    case 'f':
+        op->type = FREE;
+        op->index = field(&p, path);
+        break;
+    case 'r':
+        op->type = REALLOC;
+        op->index = field(&p, path);
+        op->size = field(&p, path);
+        break;
+    case 'c':
+        op->type = CALLOC;
+        op->index = field(&p, path);
+        op->size = field(&p, path);
+        break;
+    case 'm':
+        op->type = MEMALIGN;
+        op->index = field(&p, path);
+        op->align = field(&p, path);
+        op->size = field(&p, path);
+        break;
+    case 'b':
+        op->type = BATCH;
+        op->index = field(&p, path);
+        op->count = field(&p, path);
+        op->size = field(&p, path);
+        break;
+    case 's':
+        op->type = FREE_SIZED;
+        op->index = field(&p, path);
+        op->size = field(&p, path);
+        break;
+    case 'e':
+        op->type = ARENA;
+        op->count = field(&p, path);
+        op->size = field(&p, path);
+        break;
+    default:
+        sprintf(msg, "Bogus type character (%c) in tracefile", p[-1]);
+        trace_error(path, msg);
+    }
+
+    check_op(op, num_ids, path);
+    return 1;
+}
+
+/*
+ * load_text - parse a whole .rep trace into memory
+ */
+static void load_text(trace_t *trace, FILE *tracefile, const char *path) {
+    int max_index = 0;
+    int op_index;
+    int last;
+
+    read_header(trace, tracefile, path);
+
+    /* We'll store each request line in the trace in this array */
+    if ((trace->ops =
+         (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
+        trace_error(path, "malloc failed for the op array");
+
+    /* read every request line in the trace file */
+    op_index = 0;
+    while (op_index < trace->num_ops &&
+           parse_op(tracefile, &trace->ops[op_index], trace->num_ids, path)) {
+        if (trace->ops[op_index].type != FREE &&
+            trace->ops[op_index].type != FREE_SIZED &&
+            trace->ops[op_index].type != ARENA) {
+            last = trace->ops[op_index].index;
+            if (trace->ops[op_index].type == BATCH)
+                last += trace->ops[op_index].count - 1;
+            max_index = (last > max_index) ? last : max_index;
+        }
+        note_op(trace, &trace->ops[op_index]);
+        op_index++;
+    }
+    if (op_index != trace->num_ops)
+        trace_error(path, "text trace has fewer ops than its header");
+    if (max_index != trace->num_ids - 1)
+        trace_error(path, "text trace uses fewer ids than its header");
+}
+
+/*
+ * get_header - check the header of a binary or compressed trace, the len
+ *     bytes at buf, and copy it into trace. Returns the header's version
+ *     and sets *size to its size.
+ */
+static int get_header(const void *buf, size_t len, int compressed,
+                      trace_t *trace, size_t *size, const char *path) {
+    trace_header_t header;
+    trace_header_v2_t old;
+    int op_size = 0;
+
+    memset(&header, 0, sizeof(header));
+    memset(&old, 0, sizeof(old));
+    if (len < TRACE_V1_HEADER_SIZE)
+        trace_error(path, "truncated trace header");
+    memcpy(&header.version, (const char *)buf +
+           offsetof(trace_header_t, version), sizeof(header.version));
+
+    switch (header.version) {
+    case 1:
+    case 2:
+        /* Widen the old header */
+        *size = (header.version == 1) ? TRACE_V1_HEADER_SIZE : sizeof(old);
+        if (len < *size)
+            trace_error(path, "truncated trace header");
+        memcpy(&old, buf, *size);
+        op_size = (header.version == 1) ? sizeof(traceop_v1_t)
+                                        : sizeof(traceop_t);
+        header.op_size = old.op_size;
+        header.sugg_heapsize = old.sugg_heapsize;
+        header.num_ids = old.num_ids;
+        header.num_ops = old.num_ops;
+        header.weight = old.weight;
+        header.flags = old.flags;
+        header.num_threads = (header.version == 1) ? 1 : old.num_threads;
+        break;
+    case TRACE_VERSION:
+        if (len < sizeof(header))
+            trace_error(path, "truncated trace header");
+        memcpy(&header, buf, sizeof(header));
+        *size = sizeof(header);
+        op_size = sizeof(traceop_t);
+        break;
+    default:
+        trace_error(path, "unsupported trace version");
+    }
+
+    if (!compressed && header.op_size != op_size)
+        trace_error(path, "binary trace written with a different traceop_t");
+    if (header.num_ops < 0 || header.num_ids < 0)
+        trace_error(path, "bad counts in trace header");
+
+    trace->sugg_heapsize = header.sugg_heapsize;
+    trace->num_ids = header.num_ids;
+    trace->num_ops = header.num_ops;
+    trace->weight = header.weight;
+    trace->flags = header.flags;
+    trace->num_threads = header.num_threads;
+    return header.version;
+}
+
+/*
+ * widen_v1 - convert n version 1 records at old to ops. old may lie at
+ *     the end of the space for ops, as long as it starts no earlier
+ *     than n * sizeof(traceop_v1_t) bytes before the end of ops[n - 1].
+ */
+static void widen_v1(traceop_t *ops, const traceop_v1_t *old, int n) {
+    traceop_v1_t op;
+    int i;
+
+    /* Each record is read before its wider copy overwrites it */
+    for (i = 0; i < n; i++) {
+        op = old[i];
+        memset(&ops[i], 0, sizeof(traceop_t));
+        ops[i].type = op.type;
+        ops[i].index = op.index;
+        ops[i].size = op.size;
+        ops[i].hint = op.hint;
+    }
+}
+
+/*
+ * map_file - map the whole of tracefile into trace
+ */
+static void map_file(trace_t *trace, FILE *tracefile, const char *path) {
+    struct stat st;
+
+    if (fstat(fileno(tracefile), &st) < 0)
+        trace_error(path, "cannot stat trace");
+
+    trace->map_size = st.st_size;
+    trace->map = mmap(NULL, trace->map_size, PROT_READ, MAP_PRIVATE,
+                      fileno(tracefile), 0);
+    if (trace->map == MAP_FAILED)
+        trace_error(path, "mmap failed");
+
+    /* Replay reads the ops front to back */
+    madvise(trace->map, trace->map_size, MADV_SEQUENTIAL);
+}
+
+/*
+ * unmap_file - drop the mapping of a trace whose ops have been copied out
+ */
+static void unmap_file(trace_t *trace) {
+    munmap(trace->map, trace->map_size);
+    trace->map = NULL;
+    trace->map_size = 0;
+}
+
+/*
+ * load_bin - map a binary trace and point the op array into it, or for
+ *     version 1 widen its records into a malloc'd op array, checking each op
+ */
+static void load_bin(trace_t *trace, FILE *tracefile, const char *path) {
+    size_t header_size;
+    int version;
+
+    map_file(trace, tracefile, path);
+    version = get_header(trace->map, trace->map_size, 0, trace,
+                         &header_size, path);
+
+    if (version == 1) {
+        if (trace->map_size != header_size +
+            (size_t)trace->num_ops * sizeof(traceop_v1_t))
+            trace_error(path, "binary trace size does not match its header");
+        if ((trace->ops = (traceop_t *)
+             malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
+            trace_error(path, "malloc failed for the op array");
+        widen_v1(trace->ops, (const traceop_v1_t *)
+                 ((char *)trace->map + header_size), trace->num_ops);
+        unmap_file(trace);
+        check_ops(trace->ops, trace->num_ops, trace->num_ids, path);
+        return;
+    }
+
+    if (trace->map_size !=
+        header_size + (size_t)trace->num_ops * sizeof(traceop_t))
+        trace_error(path, "binary trace size does not match its header");
+    trace->ops = (traceop_t *)((char *)trace->map + header_size);
+    check_ops(trace->ops, trace->num_ops, trace->num_ids, path);
+}
+
+// COMPRESSED -------------------------------------------------------
+
+/* Where the ops of a compressed trace are decoded from */
+typedef struct {
+    const unsigned char *p;     /* next byte */
+    const unsigned char *end;
+    const unsigned *dict;       /* size dictionary */
+    unsigned dict_size;
+    int kind_bits;              /* low bits of an op's first varint */
+    int flags;                  /* TRACE_TIDS, TRACE_TIMES */
+    int num_ids;                /* ids the ops may name */
+    int prev_id[2];             /* last new and last existing id */
+    long prev_time;
+    const char *path;
+} zdecoder_t;
+
+static inline unsigned long get_varint(zdecoder_t *z) {
+    const unsigned char *p = z->p;
+    unsigned long v = 0;
+    int shift = 0;
+
+    do {
+        if (p == z->end || shift > 63)
+            trace_error(z->path, "corrupt compressed trace");
+        v |= (unsigned long)(*p & 0x7f) << shift;
+        shift += 7;
+    } while (*p++ & 0x80);
+
+    z->p = p;
+    return v;
+}
+
+static inline long unzigzag(unsigned long v) {
+    return (long)(v >> 1) ^ -(long)(v & 1);
+}
+
+/*
+ * get_size - decode a size, from the dictionary or literal
+ */
+static inline int get_size(zdecoder_t *z) {
+    unsigned long size = get_varint(z);
+
+    if (size & 1)
+        return size >> 1;
+    if ((size >> 1) >= z->dict_size)
+        trace_error(z->path, "size outside the dictionary");
+    return z->dict[size >> 1];
+}
+
+/*
+ * zdecode - decode up to n ops into ops, checking each one. Returns
+ *     the count, which is short only at the end of the trace.
+ */
+static int zdecode(zdecoder_t *z, traceop_t *ops, int n) {
+    static const int types[] = {ALLOC, FREE, ALLOC, REALLOC, CALLOC, MEMALIGN,
+                                BATCH};
+    unsigned long v;
+    int i, kind, existing;
+
+    for (i = 0; i < n && z->p < z->end; i++) {
+        v = get_varint(z);
+        kind = v & ((1 << z->kind_bits) - 1);
+        v >>= z->kind_bits;
+
+        memset(&ops[i], 0, sizeof(traceop_t));
+        if (kind == TRACE_Z_EXT) {
+            switch (get_varint(z)) {
+            case TRACE_ZX_FREE_SIZED: ops[i].type = FREE_SIZED; break;
+            case TRACE_ZX_ARENA:      ops[i].type = ARENA; break;
+            default:
+                trace_error(z->path, "bogus op kind in compressed trace");
+            }
+        } else {
+            ops[i].type = types[kind];
+        }
+
+        /* Frees and reallocs name blocks that already exist; an arena
+         * names none */
+        existing = (kind == TRACE_Z_FREE || kind == TRACE_Z_REALLOC ||
+                    ops[i].type == FREE_SIZED);
+        if (ops[i].type != ARENA)
+            ops[i].index = z->prev_id[existing] += unzigzag(v);
+
+        if (kind != TRACE_Z_FREE)
+            ops[i].size = get_size(z);
+        if (kind == TRACE_Z_HINT) {
+            ops[i].hint = get_varint(z);
+        } else if (kind == TRACE_Z_MEMALIGN) {
+            ops[i].align = get_varint(z);
+        } else if (kind == TRACE_Z_BATCH) {
+            z->prev_id[0] += (ops[i].count = get_varint(z)) - 1;
+        } else if (ops[i].type == ARENA) {
+            ops[i].count = get_varint(z);
+        }
+
+        if (z->flags & TRACE_TIDS)
+            ops[i].tid = get_varint(z);
+        if (z->flags & TRACE_TIMES)
+            ops[i].time = z->prev_time += unzigzag(get_varint(z));
+
+        check_op(&ops[i], z->num_ids, z->path);
+    }
+    return i;
+}
+
+/*
+ * map_z - map a compressed trace, read its header into trace and set z
+ *     up to decode its ops
+ */
+static void map_z(trace_t *trace, FILE *tracefile, const char *path,
+                  zdecoder_t *z) {
+    const char *base;
+    size_t header_size;
+    int version, dict_size;
+
+    map_file(trace, tracefile, path);
+    base = (const char *)trace->map;
+    version = get_header(base, trace->map_size, 1, trace, &header_size, path);
+
+    if (trace->map_size < header_size + sizeof(int))
+        trace_error(path, "truncated compressed trace");
+    memcpy(&dict_size, base + header_size, sizeof(int));
+    if (dict_size < 0 || trace->map_size <
+        header_size + sizeof(int) + (size_t)dict_size * sizeof(unsigned))
+        trace_error(path, "compressed trace size does not match its header");
+
+    z->dict = (const unsigned *)(base + header_size + sizeof(int));
+    z->dict_size = dict_size;
+    z->p = (const unsigned char *)(z->dict + dict_size);
+    z->end = (const unsigned char *)base + trace->map_size;
+    z->kind_bits = (version == 1) ? 2 : 3;
+    z->flags = trace->flags;
+    z->num_ids = trace->num_ids;
+    z->prev_id[0] = z->prev_id[1] = 0;
+    z->prev_time = 0;
+    z->path = path;
+}
+
+/*
+ * load_z - decode a whole compressed trace into memory
+ */
+static void load_z(trace_t *trace, FILE *tracefile, const char *path) {
+    zdecoder_t z;
+
+    map_z(trace, tracefile, path, &z);
+
+    if ((trace->ops =
+         (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
+        trace_error(path, "malloc failed for the op array");
+    if (zdecode(&z, trace->ops, trace->num_ops) != trace->num_ops)
+        trace_error(path, "compressed trace has fewer ops than its header");
+
+    unmap_file(trace);
+}
+
+trace_t *trace_load(const char *path) {
+    FILE *tracefile;
+    trace_t *trace;
+    char magic[sizeof(TRACE_MAGIC)];
+
+    if ((tracefile = fopen(path, "r")) == NULL)
+        return NULL;
+
+    if ((trace = (trace_t *)malloc(sizeof(trace_t))) == NULL)
+        trace_error(path, "malloc failed for the trace record");
+    trace->map = NULL;
+    trace->map_size = 0;
+
+    if (fread(magic, 1, sizeof(magic), tracefile) != sizeof(magic))
+        magic[0] = '\0';
+
+    if (memcmp(magic, TRACE_MAGIC, sizeof(magic)) == 0) {
+        load_bin(trace, tracefile, path);
+    } else if (memcmp(magic, TRACE_ZMAGIC, sizeof(magic)) == 0) {
+        load_z(trace, tracefile, path);
+    } else {
+        rewind(tracefile);
+        load_text(trace, tracefile, path);
+    }
+    fclose(tracefile);
+
+    alloc_blocks(trace);
+    return trace;
+}
+
+// STREAMING --------------------------------------------------------
+
+struct trace_stream {
+    FILE *file;
+    const char *path;
+    int binary;             /* records rather than text */
+    int version;            /* of the binary records */
+    int compressed;         /* ops are decoded by z */
+    zdecoder_t z;
+    int num_ids;            /* ids the ops may name */
+    int window;             /* ops per buffer */
+    int left;               /* ops the reader has yet to read */
+    traceop_t *buf[2];
+    int len[2];             /* ops in each buffer */
+    int full[2];            /* buffer filled and not yet given back */
+    int reading;            /* buffer the replay is working on, or -1 */
+    int stop;               /* tells the reader to quit early */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t reader;
+};
+
+/*
+ * fill - read up to a window of ops into buf. Returns the count.
+ */
+static int fill(trace_stream_t *stream, traceop_t *buf) {
+    int n = stream->window < stream->left ? stream->window : stream->left;
+    traceop_v1_t *old;
+    int i;
+
+    if (stream->binary && stream->version == 1) {
+        /* Read into the end of buf and widen in place */
+        old = (traceop_v1_t *)(buf + n) - n;
+        if (fread(old, sizeof(traceop_v1_t), n, stream->file) != (size_t)n)
+            trace_error(stream->path,
+                        "binary trace has fewer ops than its header");
+        widen_v1(buf, old, n);
+        check_ops(buf, n, stream->num_ids, stream->path);
+    } else if (stream->binary) {
+        if (fread(buf, sizeof(traceop_t), n, stream->file) != (size_t)n)
+            trace_error(stream->path,
+                        "binary trace has fewer ops than its header");
+        check_ops(buf, n, stream->num_ids, stream->path);
+    } else if (stream->compressed) {
+        if (zdecode(&stream->z, buf, n) != n)
+            trace_error(stream->path,
+                        "compressed trace has fewer ops than its header");
+    } else {
+        for (i = 0; i < n; i++)
+            if (!parse_op(stream->file, &buf[i], stream->num_ids,
+                          stream->path))
+                trace_error(stream->path,
+                            "text trace has fewer ops than its header");
+    }
+
+    stream->left -= n;
+    return n;
+}
+
+/*
+ * reader - fill the two buffers in turn, each as soon as the replay has
+ *     given it back, until the trace runs out
+ */
+static void *reader(void *arg) {
+    trace_stream_t *stream = (trace_stream_t *)arg;
+    int b = 0, n;
+
+    do {
+        pthread_mutex_lock(&stream->lock);
+        while (stream->full[b] && !stream->stop)
+            pthread_cond_wait(&stream->cond, &stream->lock);
+        pthread_mutex_unlock(&stream->lock);
+        /* Read outside the lock, so atomically */
+        if (__atomic_load_n(&stream->stop, __ATOMIC_ACQUIRE))
+            break;
+
+        /* The replay is not looking at this buffer: read outside the lock */
+        n = fill(stream, stream->buf[b]);
+
+        pthread_mutex_lock(&stream->lock);
+        stream->len[b] = n;
+        stream->full[b] = 1;
+        pthread_cond_broadcast(&stream->cond);
+        pthread_mutex_unlock(&stream->lock);
+
+        b ^= 1;
+    } while (n > 0);
+
+    return NULL;
+}
+
+trace_stream_t *trace_stream_open(const char *path, int window,
+                                  trace_t **tracep) {
+    trace_stream_t *stream;
+    trace_header_t header;
+    size_t header_size, len;
+    trace_t *trace;
+    FILE *file;
+
+    if ((file = fopen(path, "r")) == NULL)
+        return NULL;
+
+    if ((stream = (trace_stream_t *)calloc(1, sizeof(trace_stream_t))) == NULL ||
+        (trace = (trace_t *)calloc(1, sizeof(trace_t))) == NULL)
+        trace_error(path, "calloc failed for the trace stream");
+
+    /* Only the header is read here; the ops come from the reader */
+    len = fread(&header, 1, sizeof(header), file);
+    if (len >= sizeof(TRACE_MAGIC) &&
+        memcmp(header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) == 0) {
+        stream->version = get_header(&header, len, 0, trace, &header_size,
+                                     path);
+        fseek(file, header_size, SEEK_SET);
+        stream->binary = 1;
+    } else if (len >= sizeof(TRACE_MAGIC) &&
+               memcmp(header.magic, TRACE_ZMAGIC, sizeof(TRACE_ZMAGIC)) == 0) {
+        /* Mapped rather than read; trace_free unmaps it */
+        map_z(trace, file, path, &stream->z);
+        stream->compressed = 1;
+    } else {
+        /* The thread count of a text trace is only known at its end */
+        rewind(file);
+        read_header(trace, file, path);
+        trace->num_threads = 0;
+    }
+    alloc_blocks(trace);
+
+    stream->file = file;
+    stream->path = path;
+    stream->num_ids = trace->num_ids;
+    stream->window = window;
+    stream->left = trace->num_ops;
+    stream->reading = -1;
+    if ((stream->buf[0] = malloc(window * sizeof(traceop_t))) == NULL ||
+        (stream->buf[1] = malloc(window * sizeof(traceop_t))) == NULL)
+        trace_error(path, "malloc failed for the stream buffers");
+    pthread_mutex_init(&stream->lock, NULL);
+    pthread_cond_init(&stream->cond, NULL);
+    if (pthread_create(&stream->reader, NULL, reader, stream) != 0)
+        trace_error(path, "cannot start the reader thread");
+
+    *tracep = trace;
+    return stream;
+}
+
+int trace_stream_next(trace_stream_t *stream, traceop_t **ops) {
+    int b, n;
+
+    pthread_mutex_lock(&stream->lock);
+
+    /* Give the buffer just replayed back to the reader */
+    if (stream->reading >= 0) {
+        b = stream->reading;
+        stream->full[b] = 0;
+        pthread_cond_broadcast(&stream->cond);
+        b ^= 1;
+    } else {
+        b = 0;
+    }
+
+    while (!stream->full[b])
+        pthread_cond_wait(&stream->cond, &stream->lock);
+    stream->reading = b;
+    n = stream->len[b];
+
+    pthread_mutex_unlock(&stream->lock);
+
+    *ops = stream->buf[b];
+    return n;
+}
+
+void trace_stream_close(trace_stream_t *stream) {
+    pthread_mutex_lock(&stream->lock);
+    __atomic_store_n(&stream->stop, 1, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&stream->cond);
+    pthread_mutex_unlock(&stream->lock);
+    pthread_join(stream->reader, NULL);
+
+    pthread_mutex_destroy(&stream->lock);
+    pthread_cond_destroy(&stream->cond);
+    fclose(stream->file);
+    free(stream->buf[0]);
+    free(stream->buf[1]);
+    free(stream);
+}
+
+// WRITING ----------------------------------------------------------
+
+/*
+ * put_header - fill in the header for writing trace under magic
+ */
+static void put_header(trace_header_t *header, const trace_t *trace,
+                       const char *magic, int op_size) {
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, magic, sizeof(TRACE_MAGIC));
+    header->version = TRACE_VERSION;
+    header->op_size = op_size;
+    header->sugg_heapsize = trace->sugg_heapsize;
+    header->num_ids = trace->num_ids;
+    header->num_ops = trace->num_ops;
+    header->weight = trace->weight;
+    header->flags = trace->flags;
+    header->num_threads = trace->num_threads;
+}
+
+int trace_write_bin(const trace_t *trace, const char *path) {
+    trace_header_t header;
+    FILE *out;
+
+    put_header(&header, trace, TRACE_MAGIC, sizeof(traceop_t));
+
+    if ((out = fopen(path, "w")) == NULL)
+        return -1;
+    if (fwrite(&header, sizeof(header), 1, out) != 1 ||
+        fwrite(trace->ops, sizeof(traceop_t), trace->num_ops, out) !=
+        (size_t)trace->num_ops) {
+        fclose(out);
+        return -1;
+    }
+    return fclose(out);
+}
+
+/* A request size and how often it occurs, or its dictionary index */
+typedef struct {
+    unsigned size;
+    int count;
+} size_count_t;
+
+static int cmp_unsigned(const void *a, const void *b) {
+    unsigned x = *(const unsigned *)a, y = *(const unsigned *)b;
+    return (x > y) - (x < y);
+}
+
+/* Most frequent first, ties by size so the output is deterministic */
+static int cmp_count(const void *a, const void *b) {
+    const size_count_t *x = (const size_count_t *)a;
+    const size_count_t *y = (const size_count_t *)b;
+    if (x->count != y->count)
+        return (x->count < y->count) - (x->count > y->count);
+    return cmp_unsigned(&x->size, &y->size);
+}
+
+static void put_varint(FILE *out, unsigned long v) {
+    while (v >= 0x80) {
+        putc((v & 0x7f) | 0x80, out);
+        v >>= 7;
+    }
+    putc(v, out);
+}
+
+static unsigned long zigzag(long d) {
+    return ((unsigned long)d << 1) ^ (unsigned long)(d >> 63);
+}
+
+int trace_write_z(const trace_t *trace, const char *path) {
+    trace_header_t header;
+    size_count_t *counts, key, *found;
+    unsigned *sizes;
+    int prev_id[2] = {0, 0};
+    long prev_time = 0;
+    int i, n = 0, m = 0, dict_size = 0, kind, sub = 0, existing, err;
+    const traceop_t *op;
+    FILE *out;
+
+    /* Count the request sizes */
+    if ((sizes = (unsigned *)malloc((trace->num_ops + 1) * sizeof(unsigned))) == NULL ||
+        (counts = (size_count_t *)malloc((trace->num_ops + 1) * sizeof(size_count_t))) == NULL)
+        trace_error(path, "malloc failed for the size dictionary");
+    for (i = 0; i < trace->num_ops; i++)
+        if (trace->ops[i].type != FREE)
+            sizes[n++] = trace->ops[i].size;
+    qsort(sizes, n, sizeof(unsigned), cmp_unsigned);
+    for (i = 0; i < n; i++) {
+        if (m > 0 && counts[m - 1].size == sizes[i]) {
+            counts[m - 1].count++;
+        } else {
+            counts[m].size = sizes[i];
+            counts[m++].count = 1;
+        }
+    }
+
+    /* Sizes seen more than once go in the dictionary, most frequent first,
+     * so that they get the shortest indices */
+    qsort(counts, m, sizeof(size_count_t), cmp_count);
+    while (dict_size < m && counts[dict_size].count > 1) {
+        sizes[dict_size] = counts[dict_size].size;
+        dict_size++;
+    }
+
+    put_header(&header, trace, TRACE_ZMAGIC, 0);
+
+    if ((out = fopen(path, "w")) == NULL) {
+        free(sizes);
+        free(counts);
+        return -1;
+    }
+    fwrite(&header, sizeof(header), 1, out);
+    fwrite(&dict_size, sizeof(int), 1, out);
+    fwrite(sizes, sizeof(unsigned), dict_size, out);
+
+    /* From here on counts[] maps each dictionary size to its index; size
+     * is its first member, so it sorts and searches with cmp_unsigned */
+    for (i = 0; i < dict_size; i++)
+        counts[i].count = i;
+    qsort(counts, dict_size, sizeof(size_count_t), cmp_unsigned);
+
+    for (i = 0; i < trace->num_ops; i++) {
+        op = &trace->ops[i];
+        switch (op->type) {
+        case FREE:     kind = TRACE_Z_FREE; break;
+        case REALLOC:  kind = TRACE_Z_REALLOC; break;
+        case CALLOC:   kind = TRACE_Z_CALLOC; break;
+        case MEMALIGN: kind = TRACE_Z_MEMALIGN; break;
+        case BATCH:    kind = TRACE_Z_BATCH; break;
+        case FREE_SIZED:
+            kind = TRACE_Z_EXT;
+            sub = TRACE_ZX_FREE_SIZED;
+            break;
+        case ARENA:
+            kind = TRACE_Z_EXT;
+            sub = TRACE_ZX_ARENA;
+            break;
+        default:       kind = op->hint ? TRACE_Z_HINT : TRACE_Z_ALLOC; break;
+        }
+
+        existing = (kind == TRACE_Z_FREE || kind == TRACE_Z_REALLOC ||
+                    op->type == FREE_SIZED);
+        if (op->type == ARENA) {
+            /* Names no block: a zero delta that moves neither id */
+            put_varint(out, kind);
+        } else {
+            put_varint(out, zigzag(op->index - prev_id[existing]) << 3 | kind);
+            prev_id[existing] = op->index;
+        }
+        if (kind == TRACE_Z_EXT)
+            put_varint(out, sub);
+
+        if (kind != TRACE_Z_FREE) {
+            key.size = op->size;
+            found = (size_count_t *)bsearch(&key, counts, dict_size,
+                                            sizeof(size_count_t), cmp_unsigned);
+            put_varint(out, found ? (unsigned long)found->count << 1
+                                  : (unsigned long)op->size << 1 | 1);
+        }
+        if (kind == TRACE_Z_HINT)
+            put_varint(out, op->hint);
+        else if (kind == TRACE_Z_MEMALIGN)
+            put_varint(out, op->align);
+        else if (kind == TRACE_Z_BATCH) {
+            /* The next new id follows the last block of the batch */
+            put_varint(out, op->count);
+            prev_id[0] += op->count - 1;
+        } else if (op->type == ARENA)
+            put_varint(out, op->count);
+
+        if (trace->flags & TRACE_TIDS)
+            put_varint(out, op->tid);
+        if (trace->flags & TRACE_TIMES) {
+            put_varint(out, zigzag(op->time - prev_time));
+            prev_time = op->time;
+        }
+    }
+
+    free(sizes);
+    free(counts);
+    err = ferror(out);
+    if (fclose(out) < 0 || err)
+        return -1;
+    return 0;
+}
+
+void trace_free(trace_t *trace) {
+    if (trace->map)
+        munmap(trace->map, trace->map_size);
+    else
+        free(trace->ops);
+    free(trace->blocks);
+    free(trace->block_sizes);
+    free(trace);
+}
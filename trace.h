@@ -0,0 +1,156 @@
+#ifndef __TRACE_H_
+#define __TRACE_H_
+
+/*
+ * trace.h - allocation traces as the drivers replay them
+ *
+ * A trace comes either as text (.rep: four header numbers followed by
+ * one op per line) or in the binary format below, which is the in-memory
+ * op array written out. Binary traces are mapped and replayed in place.
+ *
+ * Text ops are
+ *
+ *     a <id> <size>             malloc
+ *     h <id> <size> <s|l>       malloc with a short/long lifetime hint
+ *     f <id>                    free
+ *     r <id> <size>             realloc
+ *     c <id> <size>             calloc of size bytes in all
+ *     m <id> <align> <size>     memalign, to a power-of-two align
+ *     b <id> <count> <size>     count mallocs of size bytes in one call,
+ *                               made as ids id to id + count - 1
+ *     s <id> <size>             free of a block of size bytes, through
+ *                               mm_free_sized
+ *     e <count> <size>          count objects of size bytes made in an
+ *                               arena, twice over with a reset between,
+ *                               then the arena destroyed; names no id
+ *
+ * Version 2 traces may start with a "#mmtrace 2" line, may contain
+ * "#" comment lines, and may prefix an op with "t<tid>", the thread that
+ * made it (0 if absent), and then "@<ns>", when it was made. Version 1
+ * traces are version 2 traces without any of these.
+ */
+#include <stddef.h>
+
+/* Characterizes a single trace operation (allocator request) */
+typedef struct {
+    enum {ALLOC, FREE, REALLOC, CALLOC, MEMALIGN, BATCH,
+          FREE_SIZED, ARENA} type;    /* request */
+    int index;                        /* index for free() to use later */
+    int size;                         /* byte size of alloc request */
+    int hint;                         /* lifetime hint for alloc, or 0 */
+    union {
+        int align;                    /* alignment for memalign, or 0 */
+        int count;                    /* blocks made by a batch, or
+                                         objects by an arena */
+    };
+    int tid;                          /* thread making the request */
+    long time;                        /* ns into the trace, or 0 */
+} traceop_t;
+
+/* Set in trace_t.flags if any op has a nonzero tid or time */
+#define TRACE_TIDS  0x1
+#define TRACE_TIMES 0x2
+
+/* Holds the information for one trace file*/
+typedef struct {
+    long sugg_heapsize;  /* suggested heap size: peak live payload bytes */
+    int num_ids;         /* number of alloc ids */
+    int num_ops;         /* number of distinct requests */
+    int weight;          /* weight of this trace in mdriver's perf index */
+    int flags;           /* TRACE_TIDS, TRACE_TIMES */
+    int num_threads;     /* 1 + highest tid, or 0 if not known yet */
+    traceop_t *ops;      /* array of requests */
+    char **blocks;       /* array of ptrs returned by malloc... */
+    size_t *block_sizes; /* ... and a corresponding array of payload sizes */
+    void *map;           /* mapping of a binary trace, or NULL */
+    size_t map_size;     /* bytes mapped */
+} trace_t;
+
+/*
+ * Binary traces start with this header, followed by num_ops traceop_t
+ * records in host byte order. op_size guards against reading a file
+ * written with a different traceop_t. Version 2 files, whose
+ * sugg_heapsize is an int, still load, and so do version 1 files, whose
+ * header also stops before flags and whose records stop after hint.
+ * Version 3 changes only the header; text traces stay at version 2.
+ */
+#define TRACE_MAGIC   "MMTRACE"
+#define TRACE_VERSION 3
+
+typedef struct {
+    char magic[8];       /* TRACE_MAGIC, NUL-terminated */
+    int version;         /* TRACE_VERSION */
+    int op_size;         /* sizeof(traceop_t) */
+    long sugg_heapsize;
+    int num_ids;
+    int num_ops;
+    int weight;
+    int flags;
+    int num_threads;
+} trace_header_t;
+
+/*
+ * Compressed traces share the header (with TRACE_ZMAGIC and op_size 0).
+ * It is followed by an int count and that many unsigned sizes, the size
+ * dictionary, most frequent first, then the ops as varints (7 bits a
+ * byte, low bits first). Each op starts with
+ *
+ *     zigzag(id - previous id) << 3 | kind
+ *
+ * where kind is a TRACE_Z_* below, and the previous id is that of the
+ * last block made (by alloc, hint, calloc, memalign or batch) or, for free,
+ * realloc and sized free, of the last op naming an existing one. Kind
+ * TRACE_Z_EXT is followed by a TRACE_ZX_* subtype: a sized free, or an
+ * arena, which names no block and so has an id delta of 0 that moves
+ * neither previous id. All but free follow with a size, as
+ * (dictionary index << 1) or (literal size << 1 | 1); a hinted alloc
+ * then with its hint, a memalign with its alignment and a batch or an
+ * arena with its count.
+ * Last come the tid if the header has TRACE_TIDS, and the zigzagged time
+ * since the previous op if it has TRACE_TIMES. Ids are mostly sequential
+ * and sizes mostly repeat, so most ops take two or three bytes. Version 1
+ * has only the first three kinds, in two bits.
+ */
+#define TRACE_ZMAGIC      "MMTRACZ"
+#define TRACE_Z_ALLOC     0
+#define TRACE_Z_FREE      1
+#define TRACE_Z_HINT      2
+#define TRACE_Z_REALLOC   3
+#define TRACE_Z_CALLOC    4
+#define TRACE_Z_MEMALIGN  5
+#define TRACE_Z_BATCH     6
+#define TRACE_Z_EXT       7
+#define TRACE_ZX_FREE_SIZED 0
+#define TRACE_ZX_ARENA      1
+
+/* Read the trace at path, text, binary or compressed. Exits on malformed
+ * traces. */
+trace_t *trace_load(const char *path);
+
+/* Write trace to path in the binary format. Returns 0, or -1 with errno. */
+int trace_write_bin(const trace_t *trace, const char *path);
+
+/* Write trace to path in the compressed format. Returns 0, or -1 with
+ * errno. */
+int trace_write_z(const trace_t *trace, const char *path);
+
+/* Free a trace returned by trace_load, unmapping it if it is binary. */
+void trace_free(trace_t *trace);
+
+/*
+ * Streaming replay, for traces too large to load: a reader thread fills
+ * one buffer of window ops while the caller replays the other.
+ * trace_stream_open returns NULL if path cannot be opened; it sets
+ * *trace to a trace_t with the header and block arrays but no ops.
+ * trace_stream_next points *ops at the next window and returns the
+ * number of ops in it, 0 at the end of the trace. The window stays valid
+ * until the next call.
+ */
+typedef struct trace_stream trace_stream_t;
+
+trace_stream_t *trace_stream_open(const char *path, int window,
+                                  trace_t **trace);
+int trace_stream_next(trace_stream_t *stream, traceop_t **ops);
+void trace_stream_close(trace_stream_t *stream);
+
+#endif /* __TRACE_H_ */
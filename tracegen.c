@@ -0,0 +1,427 @@
+/*
+ * tracegen.c - writes synthetic .rep traces
+ *
+ * Draws request sizes from a size distribution and decides which block
+ * to free from a lifetime model, keeping the live set near a target
+ * number of bytes. The same seed always produces the same trace.
+ *
+ *   tracegen -o big.rep -n 100000000 -d lognormal:64:1.5 -l random -L 2G
+ *
+ * Size distributions (-d):
+ *   uniform:<min>:<max>        uniform in [min, max]
+ *   lognormal:<median>:<sigma> log-normal around median
+ *   pow2:<min>:<max>:<p>       a power of two in [min, max] with
+ *                              probability p, else uniform in [min, max]
+ *   bimodal:<a>:<b>:<p>        within 25% of a with probability p, else
+ *                              within 25% of b
+ *
+ * Lifetime models (-l):
+ *   fifo     free the oldest live block
+ *   lifo     free the newest live block
+ *   random   free a live block picked at random
+ *   phased   allocate until the live target is reached, then free the
+ *            whole live set in random order, and start over
+ *
+ * The other models ramp up to the live target (-L) and then free one
+ * block whenever the live set is above it. Everything still live after
+ * the last allocation is freed, so traces are balanced. Ids of freed
+ * blocks are reused, so num_ids is the peak number of live blocks.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+
+/* Largest request size; traceop_t.size is an int */
+#define MAX_SIZE INT_MAX
+
+/* Width of each header number, so the header can be written at the end */
+#define HEADER_WIDTH 20
+
+/* Size distributions and lifetime models */
+typedef enum {UNIFORM, LOGNORMAL, POW2, BIMODAL} dist_kind_t;
+typedef enum {FIFO, LIFO, RANDOM, PHASED} life_kind_t;
+
+typedef struct {
+    dist_kind_t kind;
+    double a, b, p;          /* parameters, as listed above */
+} dist_t;
+
+/* A live block */
+typedef struct {
+    unsigned id;
+    unsigned size;
+} block_t;
+
+/*
+ * The live set: a ring buffer, so that fifo pops the front, lifo the
+ * back, and random swaps the chosen block with the back
+ */
+typedef struct {
+    block_t *blocks;
+    size_t cap;              /* a power of two */
+    size_t head;             /* index of the oldest block */
+    size_t len;
+    size_t bytes;            /* payload bytes live */
+} live_t;
+
+/* Freed ids, reused last-in first-out */
+typedef struct {
+    unsigned *ids;
+    size_t len, cap;
+    unsigned next;           /* lowest id never handed out */
+} ids_t;
+
+static FILE *out;
+static size_t num_ops = 0;
+static unsigned long long rng_state;
+
+static void usage(void);
+static void app_error(char *msg);
+
+/*
+ * next_random - splitmix64
+ */
+static unsigned long long next_random(void) {
+    unsigned long long z = (rng_state += 0x9E3779B97F4A7C15ULL);
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/* Uniform in [0, 1) */
+static double next_double(void) {
+    return (next_random() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* Uniform in [lo, hi] */
+static unsigned long long next_range(unsigned long long lo,
+                                     unsigned long long hi) {
+    return lo + next_random() % (hi - lo + 1);
+}
+
+/*
+ * draw_size - one request size from dist
+ */
+static unsigned draw_size(const dist_t *dist) {
+    double size = 1;
+    int lo, hi;
+
+    switch (dist->kind) {
+    case UNIFORM:
+        size = next_range(dist->a, dist->b);
+        break;
+    case LOGNORMAL: {
+        /* Box-Muller */
+        double u1 = 1.0 - next_double(), u2 = next_double();
+        double normal = sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+        size = exp(log(dist->a) + dist->b * normal);
+        break;
+    }
+    case POW2:
+        if (next_double() < dist->p) {
+            lo = (int)ceil(log2(dist->a));
+            hi = (int)floor(log2(dist->b));
+            size = lo <= hi ? ldexp(1.0, (int)next_range(lo, hi)) : dist->a;
+        } else {
+            size = next_range(dist->a, dist->b);
+        }
+        break;
+    case BIMODAL: {
+        double mode = next_double() < dist->p ? dist->a : dist->b;
+        size = mode * (0.75 + 0.5 * next_double());
+        break;
+    }
+    }
+
+    if (size < 1)
+        return 1;
+    if (size > MAX_SIZE)
+        return MAX_SIZE;
+    return (unsigned)size;
+}
+
+/*
+ * parse_dist - parse a -d argument
+ */
+static void parse_dist(char *arg, dist_t *dist) {
+    char name[16];
+    int n;
+
+    dist->a = dist->b = dist->p = 0;
+    n = sscanf(arg, "%15[a-z0-9]:%lf:%lf:%lf", name, &dist->a, &dist->b, &dist->p);
+
+    if (!strcmp(name, "uniform") && n == 3 && dist->a >= 1 && dist->b >= dist->a)
+        dist->kind = UNIFORM;
+    else if (!strcmp(name, "lognormal") && n == 3 && dist->a >= 1 && dist->b >= 0)
+        dist->kind = LOGNORMAL;
+    else if (!strcmp(name, "pow2") && n == 4 && dist->a >= 1 && dist->b >= dist->a)
+        dist->kind = POW2;
+    else if (!strcmp(name, "bimodal") && n == 4 && dist->a >= 1 && dist->b >= 1)
+        dist->kind = BIMODAL;
+    else
+        app_error("bad size distribution (-d)");
+
+    if (dist->a > MAX_SIZE || dist->b > MAX_SIZE)
+        app_error("sizes must be below 2G (-d)");
+}
+
+/*
+ * parse_life - parse a -l argument
+ */
+static life_kind_t parse_life(char *arg) {
+    if (!strcmp(arg, "fifo"))
+        return FIFO;
+    if (!strcmp(arg, "lifo"))
+        return LIFO;
+    if (!strcmp(arg, "random"))
+        return RANDOM;
+    if (!strcmp(arg, "phased"))
+        return PHASED;
+    app_error("bad lifetime model (-l)");
+    return FIFO;
+}
+
+/*
+ * parse_bytes - parse a byte count with an optional K, M or G suffix
+ */
+static size_t parse_bytes(char *arg) {
+    char *end;
+    double n = strtod(arg, &end);
+
+    switch (*end) {
+    case 'K': case 'k': n *= 1 << 10; end++; break;
+    case 'M': case 'm': n *= 1 << 20; end++; break;
+    case 'G': case 'g': n *= 1 << 30; end++; break;
+    }
+    if (*end != '\0' || n < 0)
+        app_error("bad byte count");
+    return (size_t)n;
+}
+
+/*
+ * put_header - write the four header numbers at the current position.
+ *     The suggested heap size is the peak of live payload bytes, which
+ *     mdriver sizes its heap from.
+ */
+static void put_header(size_t peak_bytes, unsigned num_ids) {
+    fprintf(out, "%*zu\n%*u\n%*zu\n%*d\n", HEADER_WIDTH, peak_bytes,
+            HEADER_WIDTH, num_ids, HEADER_WIDTH, num_ops, HEADER_WIDTH, 1);
+}
+
+/*
+ * put_op - write one op line; size is ignored for frees. Formatted by
+ *     hand, as printf would dominate the run time of big traces.
+ */
+static void put_op(char type, unsigned id, unsigned size) {
+    char line[32], digits[10];
+    int len = 0, n;
+
+    line[len++] = type;
+    line[len++] = ' ';
+    n = 0;
+    do { digits[n++] = '0' + id % 10; id /= 10; } while (id);
+    while (n) line[len++] = digits[--n];
+    if (type != 'f') {
+        line[len++] = ' ';
+        do { digits[n++] = '0' + size % 10; size /= 10; } while (size);
+        while (n) line[len++] = digits[--n];
+    }
+    line[len++] = '\n';
+
+    fwrite(line, 1, len, out);
+    num_ops++;
+}
+
+/*
+ * live_push - add a block at the back of the live set
+ */
+static void live_push(live_t *live, block_t block) {
+    if (live->len == live->cap) {
+        /* Double the ring, unwrapping it into the new array */
+        size_t cap = live->cap ? 2 * live->cap : 1024, i;
+        block_t *blocks = malloc(cap * sizeof(block_t));
+
+        if (blocks == NULL)
+            app_error("out of memory for the live set");
+        for (i = 0; i < live->len; i++)
+            blocks[i] = live->blocks[(live->head + i) & (live->cap - 1)];
+        free(live->blocks);
+        live->blocks = blocks;
+        live->cap = cap;
+        live->head = 0;
+    }
+
+    live->blocks[(live->head + live->len++) & (live->cap - 1)] = block;
+    live->bytes += block.size;
+}
+
+/*
+ * live_take - remove the block the lifetime model frees next
+ */
+static block_t live_take(live_t *live, life_kind_t life) {
+    size_t mask = live->cap - 1, back = (live->head + live->len - 1) & mask, i;
+    block_t block;
+
+    switch (life) {
+    case FIFO:
+        block = live->blocks[live->head];
+        live->head = (live->head + 1) & mask;
+        break;
+    case LIFO:
+        block = live->blocks[back];
+        break;
+    default: /* RANDOM, PHASED */
+        i = (live->head + next_range(0, live->len - 1)) & mask;
+        block = live->blocks[i];
+        live->blocks[i] = live->blocks[back];
+        break;
+    }
+
+    live->len--;
+    live->bytes -= block.size;
+    return block;
+}
+
+/*
+ * take_id, put_id - hand out and give back block ids
+ */
+static unsigned take_id(ids_t *ids) {
+    return ids->len ? ids->ids[--ids->len] : ids->next++;
+}
+
+static void put_id(ids_t *ids, unsigned id) {
+    if (ids->len == ids->cap) {
+        ids->cap = ids->cap ? 2 * ids->cap : 1024;
+        if ((ids->ids = realloc(ids->ids, ids->cap * sizeof(unsigned))) == NULL)
+            app_error("out of memory for ids");
+    }
+    ids->ids[ids->len++] = id;
+}
+
+/*
+ * free_one - free the next block of the lifetime model
+ */
+static void free_one(live_t *live, ids_t *ids, life_kind_t life) {
+    block_t block = live_take(live, life);
+
+    put_op('f', block.id, 0);
+    put_id(ids, block.id);
+}
+
+int main(int argc, char **argv) {
+    char c;
+    char *path = NULL;
+    size_t num_allocs = 100000;      /* -n */
+    size_t target = 1 << 20;         /* -L */
+    dist_t dist = {LOGNORMAL, 64, 1.0, 0};
+    life_kind_t life = RANDOM;
+    unsigned long long seed = 1;
+    live_t live = {NULL, 0, 0, 0, 0};
+    ids_t ids = {NULL, 0, 0, 0};
+    size_t peak_bytes = 0, i;
+    block_t block;
+
+    while ((c = getopt(argc, argv, "o:n:d:l:L:S:h")) != EOF) {
+        switch (c) {
+        case 'o': /* Output trace file */
+            path = optarg;
+            break;
+        case 'n': /* Number of allocations */
+            num_allocs = parse_bytes(optarg);
+            break;
+        case 'd': /* Size distribution */
+            parse_dist(optarg, &dist);
+            break;
+        case 'l': /* Lifetime model */
+            life = parse_life(optarg);
+            break;
+        case 'L': /* Live-set target in bytes */
+            target = parse_bytes(optarg);
+            break;
+        case 'S': /* Random seed */
+            seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'h':
+            usage();
+            exit(0);
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if (path == NULL || optind != argc) {
+        usage();
+        exit(1);
+    }
+    if (2 * num_allocs > 0x7fffffff)
+        app_error("read_trace counts ops in an int: at most 1G allocations");
+
+    if ((out = fopen(path, "w")) == NULL) {
+        perror(path);
+        exit(1);
+    }
+    setvbuf(out, NULL, _IOFBF, 1 << 20);
+    rng_state = seed;
+
+    /* Placeholder header, rewritten once the counts are known */
+    put_header(0, 0);
+
+    for (i = 0; i < num_allocs; i++) {
+        if (life == PHASED) {
+            /* End of a phase: tear the whole live set down */
+            if (live.bytes >= target)
+                while (live.len)
+                    free_one(&live, &ids, life);
+        } else {
+            /* Steady state: stay around the target */
+            while (live.bytes >= target && live.len)
+                free_one(&live, &ids, life);
+        }
+
+        block.id = take_id(&ids);
+        block.size = draw_size(&dist);
+        live_push(&live, block);
+        put_op('a', block.id, block.size);
+
+        if (live.bytes > peak_bytes)
+            peak_bytes = live.bytes;
+    }
+
+    /* Balance the trace */
+    while (live.len)
+        free_one(&live, &ids, life);
+
+    if (fseek(out, 0, SEEK_SET) != 0)
+        app_error("cannot rewind the output to write the header");
+    put_header(peak_bytes, ids.next);
+    if (fclose(out) != 0) {
+        perror(path);
+        exit(1);
+    }
+
+    free(live.blocks);
+    free(ids.ids);
+    return 0;
+}
+
+static void usage(void) {
+    fprintf(stderr, "Usage: tracegen -o <file> [-n <allocs>] [-d <dist>] [-l <life>] [-L <bytes>] [-S <seed>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-o <file>  Write the trace to <file>.\n");
+    fprintf(stderr, "\t-n <n>     Number of allocations, K/M/G suffixes allowed (default 100000).\n");
+    fprintf(stderr, "\t-d <dist>  Size distribution: uniform:<min>:<max>, lognormal:<median>:<sigma>,\n");
+    fprintf(stderr, "\t           pow2:<min>:<max>:<p> or bimodal:<a>:<b>:<p> (default lognormal:64:1).\n");
+    fprintf(stderr, "\t-l <life>  Lifetime model: fifo, lifo, random or phased (default random).\n");
+    fprintf(stderr, "\t-L <bytes> Live-set target in bytes, K/M/G suffixes allowed (default 1M).\n");
+    fprintf(stderr, "\t-S <seed>  Random seed (default 1).\n");
+    fprintf(stderr, "\t-h         Print this message.\n");
+}
+
+static void app_error(char *msg) {
+    fprintf(stderr, "tracegen: %s\n", msg);
+    exit(1);
+}